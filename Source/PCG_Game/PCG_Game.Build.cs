@@ -9,6 +9,6 @@ public class PCG_Game : ModuleRules
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
         PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine",
-	        "RHI","RenderCore","Renderer","RHICore","InputCore", "NavigationSystem", "AIModule", "Niagara", "EnhancedInput" });
+	        "RHI","RenderCore","Renderer","RHICore","InputCore", "NavigationSystem", "AIModule", "Niagara", "EnhancedInput", "Json" });
     }
 }
@@ -6,8 +6,8 @@
 // Sets default values
 AGrid::AGrid()
 {
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+	// 格子是静态的，大地图上每格一个 Tick 的开销不可忽略
+	PrimaryActorTick.bCanEverTick = false;
 
 	USceneComponent* SceneRoot = CreateDefaultSubobject<USceneComponent>(TEXT("SceneRoot"));
 	RootComponent = SceneRoot;
@@ -27,12 +27,6 @@ void AGrid::BeginPlay()
 	Super::BeginPlay();
 }
 
-// Called every frame
-void AGrid::Tick(float DeltaTime)
-{
-	Super::Tick(DeltaTime);
-}
-
 int32 AGrid::GetDirectionSelfBitmask(const int32 GridRotation,const int32 DirectionIndex) const 
 {
 	switch ((GridRotation + DirectionIndex)%4)
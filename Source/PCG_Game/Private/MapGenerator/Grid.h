@@ -40,9 +40,6 @@ protected:
 	virtual void BeginPlay() override;
 
 public:	
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
-
 	UPROPERTY(VisibleAnywhere,BlueprintReadOnly,Category = "Grid")
 	class UStaticMeshComponent* StaticMeshComponent;
 	
@@ -65,6 +62,9 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(Bitmask, BitmaskEnum = "/Script/PCG_Game.EGridSlot"), Category="Grid Slot Accept")
 	int32 Y_Backward_Self;
 
+	// AGridManager 随机选择时的相对权重，同类型的各个旋转共享该权重
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin = "0.0"), Category="Grid")
+	float SpawnWeight = 1.0f;
 	
 	
 	int32 GetDirectionSelfBitmask(const int32 GridRotation,const int32 DirectionIndex) const;
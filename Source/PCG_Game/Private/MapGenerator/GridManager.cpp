@@ -8,8 +8,10 @@
 // Sets default values
 AGridManager::AGridManager()
 {
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+	// 生成在 GenerateGrid 中一次完成，不需要 Tick
+	PrimaryActorTick.bCanEverTick = false;
+
+	RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("SceneRoot"));
 }
 
 // Called when the game starts or when spawned
@@ -19,150 +21,471 @@ void AGridManager::BeginPlay()
 	
 }
 
-// Called every frame
-void AGridManager::Tick(float DeltaTime)
+bool AGridManager::GenerateGrid(int32 Seed)
 {
-	Super::Tick(DeltaTime);
+	ClearGrids();
+
+	if (!SolveGridPlacements(Seed))
+		return false;
+
+	CommitGridPlacements();
+	return true;
 }
 
-void AGridManager::GenerateGrid(int32 Seed)
+bool AGridManager::SolveGridPlacements(int32 Seed)
 {
-	 InitGridStatuses();
+	FRandomStream RandomStream;
+	RandomStream.Initialize(Seed);
 
-	 // 可去重优先队列，选取可选情况最小进行塌陷
-	 TPriorityQueueUnique<FGridStatus,int32,FGridStatus::FStatusPriorityComparator> GridStatusesPriorityQueueUnique;
-	 FVector StartWorldLocation = GetActorLocation();
-	 FIntPoint StartGridLocation = FIntPoint(FMath::RandRange(0 ,X_Size-1),FMath::RandRange(0, Y_Size-1));
+	LastCollapseNum = 0;
+	LastContradictionNum = 0;
+	LastBacktrackNum = 0;
+	LastRestartNum = 0;
 
-	 // 选择初始点
-	 const int32 StartArrayIndex = GetArrayIndexFromGridLocation(StartGridLocation);
-	
-	 FRandomStream RandomStream;
-	 RandomStream.Initialize(Seed);
-	
-	 // 将初始状态入队
-	 auto& GridStatus = GridStatuses[StartArrayIndex];
-	 GridStatusesPriorityQueueUnique.Enqueue(GridStatus,GridStatus.GetValidGridWithRotationNum());
-	
-	 // BFS
-	 while (!GridStatusesPriorityQueueUnique.IsEmpty())
-	 {
-	 	FGridStatus NowGridStatus;
+	// 回溯耗尽时从新的起点重新开始，随机数流不重置，结果仍只取决于 Seed
+	bLastGenerateSucceeded = SolveGrid(RandomStream);
+	while (!bLastGenerateSucceeded && LastRestartNum < MaxRestarts)
+	{
+		LastRestartNum++;
+		bLastGenerateSucceeded = SolveGrid(RandomStream);
+	}
+
+	GridPlacements.Reset();
+	if (!bLastGenerateSucceeded)
+	{
+		UE_LOG(LogTemp,Warning,TEXT("Grid generation failed with seed %d after %d restarts"),Seed,LastRestartNum);
+		return false;
+	}
+
+	// 每个格子已塌陷为唯一的 (类型, 旋转)
+	GridPlacements.SetNum(GridStatuses.Num());
+	for (int32 ArrayIndex = 0;ArrayIndex < GridStatuses.Num();++ArrayIndex)
+	{
+		FGridPlacement& Placement = GridPlacements[ArrayIndex];
+		GridStatuses[ArrayIndex].GetGridWithRotationByValidIndex(0,Placement.GridClassIndex,Placement.GridRotation);
+	}
+	return true;
+}
+
+void AGridManager::CommitGridPlacements()
+{
+	ClearGrids();
+
+	if (GridPlacements.Num() != X_Size*Y_Size)
+		return;
+
+	if (OutputMode == EGridOutputMode::InstancedMeshes)
+	{
+		CommitInstancedMeshes();
+	}
+	else
+	{
+		SpawnGrids();
+	}
+}
+
+void AGridManager::ClearGrids()
+{
+	// 组件保留，下次生成直接复用
+	for (UHierarchicalInstancedStaticMeshComponent* MeshComponent : GridMeshComponents)
+	{
+		if (IsValid(MeshComponent))
+		{
+			MeshComponent->ClearInstances();
+		}
+	}
+
+	for (AGrid* Grid : Grids)
+	{
+		if (IsValid(Grid))
+		{
+			Grid->Destroy();
+		}
+	}
+	Grids.Reset();
+}
+
+bool AGridManager::SolveGrid(FRandomStream& RandomStream)
+{
+	InitGridStatuses();
+
+	const int32 GridStatusNums = GridStatuses.Num();
+	if (GridStatusNums == 0 || GridClasses.Num() == 0)
+		return false;
+
+	GridStatusesPriorityQueue.Reset(GridStatusNums);
+	Trail.Reset();
+	Decisions.Reset();
+	GridStatusTrailSerials.Init(INDEX_NONE,GridStatusNums);
+	TrailSerial = 0;
+	AttemptBacktrackNum = 0;
+
+	// 选择初始点
+	const FIntPoint StartGridLocation = FIntPoint(RandomStream.RandRange(0,X_Size-1),RandomStream.RandRange(0,Y_Size-1));
+	const int32 StartArrayIndex = GetArrayIndexFromGridLocation(StartGridLocation);
+	GridStatusesPriorityQueue.Enqueue(StartArrayIndex,GridStatuses[StartArrayIndex].GetValidGridWithRotationNum());
+
+	int32 NextUnvisitedIndex = 0;
+	while (true)
+	{
+		int32 ArrayIndex = INDEX_NONE;
 		int32 NowValidGridNum;
-	 	GridStatusesPriorityQueueUnique.Dequeue(NowGridStatus,NowValidGridNum);
-
-	 	NowGridStatus.SetIsCompleted(true);
-	 	
-	 	// 权重随机算法 这里先均分概率
-	 	int32 ValidCounts = NowGridStatus.GetValidGridWithRotationNum();
-	 	if (ValidCounts == 0)
-	 	{
-	 		// 处理所有情况都被剔除时
-	 		// 尽可能不出现该情况，可能塞一个空？
-			UE_LOG(LogTemp, Display, TEXT("Fail To Search Next Grid"));
-	 	}
-	 	int32 RandomIndex = RandomStream.FRandRange(0,ValidCounts);
-	 	
-	 	int32 GridIndex,GridRotation;
-	 	NowGridStatus.GetGridWithRotationByValidIndex(RandomIndex,GridIndex,GridRotation);
-	 	FIntPoint GridLocation = NowGridStatus.GetGridLocation();
-	 	
-		FActorSpawnParameters SpawnParameters;
-		SpawnParameters.Owner = this;
-		SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
-	 	int32 ArrayIndex = GetArrayIndexFromGridLocation(GridLocation);
-	 	
-	 	FVector Location = StartWorldLocation + FVector(GridLocation.X*GridSpacing, GridLocation.Y*GridSpacing, 0);
-	 	FRotator Rotator;
-	 	NowGridStatus.GetRotatorByGridRotation(GridRotation,Rotator);
-
-	 	AGrid* NewGrid;
-	 	if (NewGrid = GetWorld()->SpawnActor<AGrid>(GridClasses[GridIndex],Location,Rotator,SpawnParameters); NewGrid != nullptr)
-	 	{
-	 		Grids[ArrayIndex] = NewGrid;
-	 	}
-	 	else
-	 	{
-	 		UE_LOG(LogTemp,Error,TEXT("%s"),TEXT("Failed to Spawn Grid"));
-	 	}
-
-	 	// 2D Status
-	 	const TArray<TPair<int32,int32>> NextGridDelta =
-	 		{
-	 			{1,0},{0,1},{-1,0},{0,-1}
-	 		};
-	 	int DirectionIndex = 0;
-
-	 	// 4 个方向
-	 	for (auto& NextPair:NextGridDelta) {
-	 		int32 DeltaX = NextPair.Key;
-	 		int32 DeltaY = NextPair.Value;
-	 		int32 NewX = GridLocation.X+DeltaX;
-	 		int32 NewY = GridLocation.Y+DeltaY;
-	 		
-	 		if(NewX<0||NewX>=X_Size||NewY<0||NewY>=Y_Size)
-	 			continue;
-	 		int NextGridArrayIndex = GetArrayIndexFromGridLocation(FIntPoint(NewX,NewY));
-	 		auto& NextGridStatus = GridStatuses[NextGridArrayIndex];
-	 		if(!NextGridStatus.IsCompleted())
-	 		{
-	 			int32 AcceptBitmask = NewGrid->GetDirectionAcceptBitmask(GridRotation,DirectionIndex);
-	 			int32 SelfBitmask = NewGrid->GetDirectionSelfBitmask(GridRotation,DirectionIndex);
-	 			int32 OppositeDirectionIndex = GetOppositeDirectionIndex(DirectionIndex);
-
-	 			// 根据新 Grid 的 SlotBitMask 更新对应位置的 GridStatus，去除不可能对象
-	 			
-	 			UpdateGridStatesByGridSlotBitmask(NextGridArrayIndex,OppositeDirectionIndex,AcceptBitmask,SelfBitmask);
-	 			
-	 			GridStatusesPriorityQueueUnique.Enqueue(NextGridStatus,NextGridStatus.GetValidGridWithRotationNum());
-	 		}
-	 		DirectionIndex++;
-	 	}
-
-	 	GridStatuses[ArrayIndex] = NowGridStatus; 
+		while (GridStatusesPriorityQueue.Dequeue(ArrayIndex,NowValidGridNum) && GridStatuses[ArrayIndex].IsCompleted())
+		{
+			ArrayIndex = INDEX_NONE;
+		}
+
+		// 队列为空时补上尚未访问的格子，全部塌陷即成功
+		if (ArrayIndex == INDEX_NONE)
+		{
+			while (NextUnvisitedIndex < GridStatusNums && GridStatuses[NextUnvisitedIndex].IsCompleted())
+			{
+				NextUnvisitedIndex++;
+			}
+			if (NextUnvisitedIndex == GridStatusNums)
+				return true;
+			ArrayIndex = NextUnvisitedIndex;
+		}
+
+		FGridStatus& NowGridStatus = GridStatuses[ArrayIndex];
+
+		// 传播保证队列中的格子至少有一个候选
+		const int32 ValidCounts = NowGridStatus.GetValidGridWithRotationNum();
+		check(ValidCounts > 0);
+
+		// 权重随机算法，权重全部相同时直接均分
+		int32 GridIndex,GridRotation;
+		if (bUniformGridTypeWeights)
+		{
+			NowGridStatus.GetGridWithRotationByValidIndex(RandomStream.RandRange(0,ValidCounts-1),GridIndex,GridRotation);
+		}
+		else
+		{
+			NowGridStatus.GetGridWithRotationByWeight(GridTypeWeights,RandomStream.FRand(),GridIndex,GridRotation);
+		}
+
+		Decisions.Add({ArrayIndex,GridIndex,GridRotation,Trail.Num()});
+		TrailSerial++;
+		SaveGridStatus(ArrayIndex);
+		NowGridStatus.CollapseTo(GridIndex,GridRotation);
+		LastCollapseNum++;
+
+		// 4 个方向的未塌陷邻居作为新的边界
+		for (int32 DirectionIndex = 0;DirectionIndex < DirectionNums;++DirectionIndex)
+		{
+			const int32 NextGridArrayIndex = GetNeighborArrayIndex(ArrayIndex,DirectionIndex);
+			if (NextGridArrayIndex != INDEX_NONE && !GridStatuses[NextGridArrayIndex].IsCompleted())
+			{
+				GridStatusesPriorityQueue.Enqueue(NextGridArrayIndex,GridStatuses[NextGridArrayIndex].GetValidGridWithRotationNum());
+			}
+		}
+
+		if (!PropagateGridStatus(ArrayIndex) && !Backtrack())
+			return false;
+	}
+}
+
+bool AGridManager::PropagateGridStatus(const int32 ArrayIndex)
+{
+	PropagationStack.Reset();
+	PropagationStack.Add(ArrayIndex);
+
+	while (PropagationStack.Num() > 0)
+	{
+		const int32 NowArrayIndex = PropagationStack.Pop(EAllowShrinking::No);
+		const TBitArray<>& NowValidGridRotations = GridStatuses[NowArrayIndex].GetValidGridRotationList();
+
+		for (int32 DirectionIndex = 0;DirectionIndex < DirectionNums;++DirectionIndex)
+		{
+			const int32 NextGridArrayIndex = GetNeighborArrayIndex(NowArrayIndex,DirectionIndex);
+			if (NextGridArrayIndex == INDEX_NONE)
+				continue;
+
+			// 本格所有候选在该方向上出现的 (Accept, Self) 掩码组合，最多 64 种
+			uint64 SlotMaskPairs = 0;
+			for (TConstSetBitIterator<> It(NowValidGridRotations);It;++It)
+			{
+				const FGridSlotMasks& SlotMasks = GridSlotMasks[It.GetIndex() * DirectionNums + DirectionIndex];
+				SlotMaskPairs |= uint64(1) << ((SlotMasks.AcceptBitmask & (GridSlotMaskNums - 1)) * GridSlotMaskNums + (SlotMasks.SelfBitmask & (GridSlotMaskNums - 1)));
+			}
+
+			// 邻居仍受支持的候选为各掩码组合兼容位集的并集
+			const int32 OppositeDirectionIndex = GetOppositeDirectionIndex(DirectionIndex);
+			PropagationScratch.Init(false,GridClasses.Num() * RotationNums);
+			while (SlotMaskPairs != 0)
+			{
+				const int32 SlotMaskPair = FMath::CountTrailingZeros64(SlotMaskPairs);
+				SlotMaskPairs &= SlotMaskPairs - 1;
+				PropagationScratch.CombineWithBitwiseOR(CompatibleGridRotations[OppositeDirectionIndex * GridSlotMaskNums * GridSlotMaskNums + SlotMaskPair],EBitwiseOperatorFlags::MaintainSize);
+			}
+
+			FGridStatus& NextGridStatus = GridStatuses[NextGridArrayIndex];
+			if (!NextGridStatus.HasIncompatibleGridRotations(PropagationScratch))
+				continue;
+
+			SaveGridStatus(NextGridArrayIndex);
+			NextGridStatus.FilterGridRotations(PropagationScratch);
+
+			const int32 NextValidGridNum = NextGridStatus.GetValidGridWithRotationNum();
+			if (NextValidGridNum == 0)
+			{
+				LastContradictionNum++;
+				return false;
+			}
+
+			if (!NextGridStatus.IsCompleted())
+			{
+				GridStatusesPriorityQueue.Enqueue(NextGridArrayIndex,NextValidGridNum);
+			}
+			PropagationStack.Add(NextGridArrayIndex);
+		}
 	}
+
+	return true;
+}
+
+bool AGridManager::Backtrack()
+{
+	while (Decisions.Num() > 0 && AttemptBacktrackNum < MaxBacktracks)
+	{
+		AttemptBacktrackNum++;
+		LastBacktrackNum++;
+		const FGridDecision Decision = Decisions.Pop(EAllowShrinking::No);
+		UndoTrail(Decision.TrailNum);
+
+		// 剔除属于上一层的选择，之后的修改需要重新记录
+		TrailSerial++;
+		SaveGridStatus(Decision.ArrayIndex);
+		FGridStatus& GridStatus = GridStatuses[Decision.ArrayIndex];
+		GridStatus.BanGridRotation(Decision.GridTypeIndex,Decision.GridRotation);
+
+		const int32 ValidGridNum = GridStatus.GetValidGridWithRotationNum();
+		if (ValidGridNum == 0)
+		{
+			LastContradictionNum++;
+			continue;
+		}
+
+		GridStatusesPriorityQueue.Enqueue(Decision.ArrayIndex,ValidGridNum);
+		if (PropagateGridStatus(Decision.ArrayIndex))
+			return true;
+	}
+
+	return false;
+}
+
+void AGridManager::SaveGridStatus(const int32 ArrayIndex)
+{
+	if (GridStatusTrailSerials[ArrayIndex] == TrailSerial)
+		return;
+
+	GridStatusTrailSerials[ArrayIndex] = TrailSerial;
+	Trail.Add({ArrayIndex,GridStatuses[ArrayIndex]});
+}
+
+void AGridManager::UndoTrail(const int32 TrailNum)
+{
+	while (Trail.Num() > TrailNum)
+	{
+		FGridTrailEntry& Entry = Trail.Last();
+		FGridStatus& GridStatus = GridStatuses[Entry.ArrayIndex];
+		GridStatus = MoveTemp(Entry.PreviousStatus);
+		GridStatusTrailSerials[Entry.ArrayIndex] = INDEX_NONE;
+
+		// 恢复后的可选情况只会变多，重新入队以更新优先级
+		if (!GridStatus.IsCompleted())
+		{
+			GridStatusesPriorityQueue.Enqueue(Entry.ArrayIndex,GridStatus.GetValidGridWithRotationNum());
+		}
+		Trail.Pop(EAllowShrinking::No);
+	}
+}
+
+void AGridManager::SpawnGrids()
+{
+	const FVector StartWorldLocation = GetActorLocation();
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.Owner = this;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	Grids.SetNumZeroed(GridPlacements.Num());
+	for (int32 ArrayIndex = 0;ArrayIndex < GridPlacements.Num();++ArrayIndex)
+	{
+		const FGridPlacement& Placement = GridPlacements[ArrayIndex];
+		const int32 GridX = ArrayIndex / Y_Size;
+		const int32 GridY = ArrayIndex % Y_Size;
+
+		FVector Location = StartWorldLocation + FVector(GridX*GridSpacing, GridY*GridSpacing, 0);
+		const FRotator Rotator(0, Placement.GridRotation * 90.0f, 0);
+
+		AGrid* NewGrid;
+		if (NewGrid = GetWorld()->SpawnActor<AGrid>(GridClasses[Placement.GridClassIndex],Location,Rotator,SpawnParameters); NewGrid != nullptr)
+		{
+			Grids[ArrayIndex] = NewGrid;
+		}
+		else
+		{
+			UE_LOG(LogTemp,Error,TEXT("%s"),TEXT("Failed to Spawn Grid"));
+		}
+	}
+}
+
+void AGridManager::CommitInstancedMeshes()
+{
+	// 先按类型收集变换，每个组件只调用一次 AddInstances
+	TArray<TArray<FTransform>> InstancesByClass;
+	InstancesByClass.SetNum(GridClasses.Num());
+	for (int32 ArrayIndex = 0;ArrayIndex < GridPlacements.Num();++ArrayIndex)
+	{
+		const FGridPlacement& Placement = GridPlacements[ArrayIndex];
+		const FVector Location(ArrayIndex / Y_Size * GridSpacing, ArrayIndex % Y_Size * GridSpacing, 0);
+		InstancesByClass[Placement.GridClassIndex].Add(FTransform(FRotator(0, Placement.GridRotation * 90.0f, 0),Location));
+	}
+
+	for (int32 GridClassIndex = 0;GridClassIndex < GridClasses.Num();++GridClassIndex)
+	{
+		TArray<FTransform>& Instances = InstancesByClass[GridClassIndex];
+		if (Instances.Num() == 0)
+			continue;
+
+		UHierarchicalInstancedStaticMeshComponent* MeshComponent = GetOrCreateMeshComponent(GridClassIndex);
+		if (!MeshComponent)
+			continue;
+
+		// 保留 CDO 中 Mesh 组件相对 AGrid 根节点的偏移
+		const FTransform MeshRelativeTransform = GridClasses[GridClassIndex].GetDefaultObject()->StaticMeshComponent->GetRelativeTransform();
+		for (FTransform& Instance : Instances)
+		{
+			Instance = MeshRelativeTransform * Instance;
+		}
+		MeshComponent->AddInstances(Instances,false);
+	}
+}
+
+UHierarchicalInstancedStaticMeshComponent* AGridManager::GetOrCreateMeshComponent(const int32 GridClassIndex)
+{
+	if (GridMeshComponents.Num() != GridClasses.Num())
+	{
+		// GridClasses 变化后下标不再对应，旧组件全部销毁
+		for (UHierarchicalInstancedStaticMeshComponent* MeshComponent : GridMeshComponents)
+		{
+			if (IsValid(MeshComponent))
+			{
+				MeshComponent->DestroyComponent();
+			}
+		}
+		GridMeshComponents.Init(nullptr,GridClasses.Num());
+	}
+
+	const UStaticMeshComponent* GridMeshComponent = GridClasses[GridClassIndex].GetDefaultObject()->StaticMeshComponent;
+	UStaticMesh* Mesh = GridMeshComponent->GetStaticMesh();
+	if (!Mesh)
+	{
+		UE_LOG(LogTemp,Warning,TEXT("Grid %s has no static mesh"),*GridClasses[GridClassIndex]->GetName());
+		return nullptr;
+	}
+
+	UHierarchicalInstancedStaticMeshComponent*& MeshComponent = GridMeshComponents[GridClassIndex];
+	if (!IsValid(MeshComponent))
+	{
+		MeshComponent = NewObject<UHierarchicalInstancedStaticMeshComponent>(this);
+		MeshComponent->SetupAttachment(RootComponent);
+		MeshComponent->RegisterComponent();
+		AddInstanceComponent(MeshComponent);
+	}
+
+	// 同步 CDO 上可能在编辑器中修改的 Mesh 与材质
+	MeshComponent->SetStaticMesh(Mesh);
+	for (int32 MaterialIndex = 0;MaterialIndex < GridMeshComponent->GetNumMaterials();++MaterialIndex)
+	{
+		MeshComponent->SetMaterial(MaterialIndex,GridMeshComponent->GetMaterial(MaterialIndex));
+	}
+	return MeshComponent;
 }
 
 void AGridManager::UpdateGridStatesByGridSlotBitmask(const int32 GridStatesIndex,const int32 DirectionIndex,const int32 AcceptBitmask,const int32 SelfBitMask)
 {
-	FGridStatus& GridStatus = GridStatuses[GridStatesIndex];
+	// 蓝图可直接调用，下标与方向需在此校验；连接表在 SolveGridPlacements 中构建
+	const int32 TableIndex = (DirectionIndex * GridSlotMaskNums + (AcceptBitmask & (GridSlotMaskNums - 1))) * GridSlotMaskNums + (SelfBitMask & (GridSlotMaskNums - 1));
+	if (!GridStatuses.IsValidIndex(GridStatesIndex) || DirectionIndex < 0 || DirectionIndex >= DirectionNums || !CompatibleGridRotations.IsValidIndex(TableIndex))
+	{
+		UE_LOG(LogTemp,Warning,TEXT("UpdateGridStatesByGridSlotBitmask: invalid grid status %d or direction %d"),GridStatesIndex,DirectionIndex);
+		return;
+	}
+
+	// 冲突的 (类型, 旋转) 已在连接表中预先排除
+	GridStatuses[GridStatesIndex].FilterGridRotations(CompatibleGridRotations[TableIndex]);
+}
+
+void AGridManager::BuildConnectionTable()
+{
+	const int32 GridTypeNums = GridClasses.Num();
 
-	// 目前可能的 Grid 对象
-	TArray<int32> ValidGridTypeIndexArray;
-	GridStatus.GetValidGridIndexArray(ValidGridTypeIndexArray);
-	for (int32 GridTypeIndex:ValidGridTypeIndexArray)
+	GridSlotMasks.SetNum(GridTypeNums * RotationNums * DirectionNums);
+	for (int32 GridTypeIndex = 0;GridTypeIndex < GridTypeNums;++GridTypeIndex)
 	{
-		// 目前该 Gird 对象可能的旋转情况
-		TArray<int32> ValidGridRotationIndexArray;
-		GridStatus.GetValidGridRotationIndexArray(GridTypeIndex,ValidGridRotationIndexArray);
-		int RotationCounts = ValidGridRotationIndexArray.Num();
-		
-		for (int32 RotationIndex:ValidGridRotationIndexArray)
+		const AGrid* GridCDO = GridClasses[GridTypeIndex].GetDefaultObject();
+		for (int32 GridRotation = 0;GridRotation < RotationNums;++GridRotation)
 		{
-			// 若该可能会发生冲突，则剔除
-			if (!GridClasses[GridTypeIndex].GetDefaultObject()->CheckConnectionValid(RotationIndex,DirectionIndex,AcceptBitmask,SelfBitMask))
+			for (int32 DirectionIndex = 0;DirectionIndex < DirectionNums;++DirectionIndex)
 			{
-				GridStatus.SetGridRotationValid(GridTypeIndex,RotationIndex,false);
-				RotationCounts--;
+				FGridSlotMasks& SlotMasks = GridSlotMasks[(GridTypeIndex * RotationNums + GridRotation) * DirectionNums + DirectionIndex];
+				SlotMasks.SelfBitmask = GridCDO->GetDirectionSelfBitmask(GridRotation,DirectionIndex);
+				SlotMasks.AcceptBitmask = GridCDO->GetDirectionAcceptBitmask(GridRotation,DirectionIndex);
+				if (SlotMasks.SelfBitmask >= GridSlotMaskNums || SlotMasks.AcceptBitmask >= GridSlotMaskNums)
+				{
+					UE_LOG(LogTemp,Warning,TEXT("Grid %s has slot bits outside EGridSlot"),*GridClasses[GridTypeIndex]->GetName());
+				}
 			}
 		}
+	}
 
-		if (RotationCounts == 0)
-			GridStatus.SetGridValid(GridTypeIndex,false);
+	// 每个方向、每种邻居掩码组合下逐一调用 CheckConnectionValid，语义与逐格检查完全一致
+	CompatibleGridRotations.SetNum(DirectionNums * GridSlotMaskNums * GridSlotMaskNums);
+	for (int32 DirectionIndex = 0;DirectionIndex < DirectionNums;++DirectionIndex)
+	{
+		for (int32 AcceptBitmask = 0;AcceptBitmask < GridSlotMaskNums;++AcceptBitmask)
+		{
+			for (int32 SelfBitmask = 0;SelfBitmask < GridSlotMaskNums;++SelfBitmask)
+			{
+				TBitArray<>& Compatible = CompatibleGridRotations[(DirectionIndex * GridSlotMaskNums + AcceptBitmask) * GridSlotMaskNums + SelfBitmask];
+				Compatible.Init(false,GridTypeNums * RotationNums);
+				for (int32 GridTypeIndex = 0;GridTypeIndex < GridTypeNums;++GridTypeIndex)
+				{
+					const AGrid* GridCDO = GridClasses[GridTypeIndex].GetDefaultObject();
+					for (int32 GridRotation = 0;GridRotation < RotationNums;++GridRotation)
+					{
+						Compatible[GridTypeIndex * RotationNums + GridRotation] = GridCDO->CheckConnectionValid(GridRotation,DirectionIndex,AcceptBitmask,SelfBitmask);
+					}
+				}
+			}
+		}
 	}
 }
 
 void AGridManager::InitGridStatuses()
 {
-	Grids.SetNumUninitialized(X_Size*Y_Size);
+	// Grid 蓝图的插槽掩码可能在编辑器中修改，每次生成都从 CDO 重建；表很小，开销可以忽略
+	BuildConnectionTable();
+
+	// SpawnWeight 同理，每次生成前重新读取
+	GridTypeWeights.SetNum(GridClasses.Num());
+	bUniformGridTypeWeights = true;
+	for (int32 GridTypeIndex = 0;GridTypeIndex < GridClasses.Num();++GridTypeIndex)
+	{
+		GridTypeWeights[GridTypeIndex] = FMath::Max(GridClasses[GridTypeIndex].GetDefaultObject()->SpawnWeight,0.0f);
+		bUniformGridTypeWeights &= GridTypeWeights[GridTypeIndex] == GridTypeWeights[0];
+	}
+
+	// 重复生成时丢弃上一次的状态，保证下标与格子一一对应
+	GridStatuses.Reset(X_Size*Y_Size);
 	for (int32 X = 0; X < X_Size; X++)
 	{
 		for (int32 Y = 0; Y < Y_Size; Y++)
 		{
 			const FIntPoint GridLocation = FIntPoint(X, Y);
 			const int32 GridTypeNums = GridClasses.Num();
-			// 2D With 4 Direction ; 3D With 6 Direction
-			constexpr int32 RotationNums = 4;
 			GridStatuses.Add(FGridStatus(GridLocation,GridTypeNums,RotationNums));
 		}
 	}
@@ -178,3 +501,18 @@ int32 AGridManager::GetArrayIndexFromGridLocation(const FIntPoint GridLocation)
 	return GridLocation.X * Y_Size + GridLocation.Y; 
 }
 
+int32 AGridManager::GetNeighborArrayIndex(const int32 ArrayIndex,const int32 DirectionIndex) const
+{
+	// 2D Status，方向顺序与连接表一致
+	static const FIntPoint NextGridDelta[DirectionNums] =
+		{
+			{1,0},{0,1},{-1,0},{0,-1}
+		};
+
+	const int32 NewX = ArrayIndex / Y_Size + NextGridDelta[DirectionIndex].X;
+	const int32 NewY = ArrayIndex % Y_Size + NextGridDelta[DirectionIndex].Y;
+	if(NewX<0||NewX>=X_Size||NewY<0||NewY>=Y_Size)
+		return INDEX_NONE;
+	return GetArrayIndexFromGridLocation(FIntPoint(NewX,NewY));
+}
+
@@ -4,9 +4,33 @@
 
 #include "CoreMinimal.h"
 #include "Grid.h"
+#include "PriorityQueueUnique.h"
 #include "GameFramework/Actor.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
 #include "GridManager.generated.h"
 
+UENUM(BlueprintType)
+enum class EGridOutputMode : uint8
+{
+	// 每个格子生成一个 AGrid
+	Actors				UMETA(DisplayName = "Actors"),
+	// 每种 AGrid 类一个 HISM 组件，使用 CDO 的 Mesh，按实例设置朝向
+	InstancedMeshes		UMETA(DisplayName = "Instanced Meshes"),
+};
+
+// 求解结果，GridClassIndex 为 GridClasses 下标，GridRotation 为 90° 的倍数
+USTRUCT(BlueprintType)
+struct FGridPlacement
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere,BlueprintReadOnly,Category = "Grid")
+	int32 GridClassIndex = INDEX_NONE;
+
+	UPROPERTY(VisibleAnywhere,BlueprintReadOnly,Category = "Grid")
+	int32 GridRotation = 0;
+};
+
 UCLASS()
 class AGridManager : public AActor
 {
@@ -23,15 +47,17 @@ class AGridManager : public AActor
 		
 		TBitArray<> m_ValidGridList;
 		TBitArray<> m_ValidGridRotationList;
+		// m_ValidGridRotationList 的置位数，随每次修改同步更新
+		int32 m_ValidGridRotationNum;
 		
 	public:
 		FGridStatus()
-			:m_GridLocation(FIntPoint()),m_RotationNums(0),m_GridTypeNums(0)
+			:m_GridLocation(FIntPoint()),m_RotationNums(0),m_GridTypeNums(0),m_ValidGridRotationNum(0)
 		{}
 		
 		
 		FGridStatus(FIntPoint GridLocation,int32 GridTypeNums,int32 RotationNums)
-			:m_GridLocation(GridLocation),m_RotationNums(RotationNums),m_GridTypeNums(GridTypeNums)
+			:m_GridLocation(GridLocation),m_RotationNums(RotationNums),m_GridTypeNums(GridTypeNums),m_ValidGridRotationNum(RotationNums * GridTypeNums)
 		{
 			m_ValidGridList.Init(true,m_GridTypeNums);
 			m_ValidGridRotationList.Init(true,m_RotationNums * m_GridTypeNums);
@@ -47,17 +73,6 @@ class AGridManager : public AActor
 			m_IsComplete = IsCompleted;
 		}
 		
-		bool operator==(const FGridStatus& Other) const
-		{
-			return Other.GetGridLocation() == GetGridLocation();
-		}
-
-		friend uint32 GetTypeHash(const FGridStatus& Status)
-		{
-			return GetTypeHash(Status.m_GridLocation);
-
-		}
-		
 		bool IsValidGrid(const int32 GridTypeIndex)
 		{
 			check(GridTypeIndex < m_GridTypeNums)
@@ -82,7 +97,11 @@ class AGridManager : public AActor
 			check(GridTypeIndex < m_GridTypeNums);
 			check(RotationIndex < m_RotationNums);
 			const int32 RotationBitIndex = GetRotationBitIndex(GridTypeIndex,RotationIndex);
-			m_ValidGridRotationList[RotationBitIndex] = IsValid; 
+			if (m_ValidGridRotationList[RotationBitIndex] != IsValid)
+			{
+				m_ValidGridRotationList[RotationBitIndex] = IsValid;
+				m_ValidGridRotationNum += IsValid ? 1 : -1;
+			}
 		}
 
 		FIntPoint GetGridLocation() const 
@@ -97,7 +116,7 @@ class AGridManager : public AActor
 
 		int32 GetValidGridWithRotationNum() const
 		{
-			return m_ValidGridRotationList.CountSetBits();
+			return m_ValidGridRotationNum;
 		}
 
 		void GetValidGridIndexArray(TArray<int32>& ValidIndexArray) const
@@ -138,25 +157,132 @@ class AGridManager : public AActor
 			}
 		}
 
+		// 与预计算的兼容位集按位与，并同步剔除已无任何旋转可用的类型
+		void FilterGridRotations(const TBitArray<>& CompatibleGridRotations)
+		{
+			m_ValidGridRotationList.CombineWithBitwiseAND(CompatibleGridRotations,EBitwiseOperatorFlags::MaintainSize);
+			m_ValidGridRotationNum = m_ValidGridRotationList.CountSetBits();
+			for (int32 GridTypeIndex = 0;GridTypeIndex < m_GridTypeNums;++GridTypeIndex)
+			{
+				if (!m_ValidGridList[GridTypeIndex])
+					continue;
+
+				bool HasValidRotation = false;
+				for (int32 i = 0;i < m_RotationNums && !HasValidRotation;++i)
+				{
+					HasValidRotation = m_ValidGridRotationList[GetRotationBitIndex(GridTypeIndex,i)];
+				}
+				m_ValidGridList[GridTypeIndex] = HasValidRotation;
+			}
+		}
+
+		// 是否存在不在兼容位集中的 (类型, 旋转)，即 FilterGridRotations 是否会改变状态
+		bool HasIncompatibleGridRotations(const TBitArray<>& CompatibleGridRotations) const
+		{
+			const uint32* ValidWords = m_ValidGridRotationList.GetData();
+			const uint32* CompatibleWords = CompatibleGridRotations.GetData();
+			const int32 NumWords = FBitSet::CalculateNumWords(m_ValidGridRotationList.Num());
+			for (int32 i = 0;i < NumWords;++i)
+			{
+				if (ValidWords[i] & ~CompatibleWords[i])
+					return true;
+			}
+			return false;
+		}
+
+		const TBitArray<>& GetValidGridRotationList() const
+		{
+			return m_ValidGridRotationList;
+		}
+
+		// 塌陷为唯一的 (类型, 旋转)
+		void CollapseTo(const int32 GridTypeIndex,const int32 GridRotation)
+		{
+			m_ValidGridList.Init(false,m_GridTypeNums);
+			m_ValidGridRotationList.Init(false,m_RotationNums * m_GridTypeNums);
+			m_ValidGridList[GridTypeIndex] = true;
+			m_ValidGridRotationList[GetRotationBitIndex(GridTypeIndex,GridRotation)] = true;
+			m_ValidGridRotationNum = 1;
+			m_IsComplete = true;
+		}
+
+		// 剔除单个 (类型, 旋转)，回溯时排除已失败的选择
+		void BanGridRotation(const int32 GridTypeIndex,const int32 GridRotation)
+		{
+			const int32 RotationBitIndex = GetRotationBitIndex(GridTypeIndex,GridRotation);
+			if (!m_ValidGridRotationList[RotationBitIndex])
+				return;
+
+			m_ValidGridRotationList[RotationBitIndex] = false;
+			m_ValidGridRotationNum--;
+
+			bool HasValidRotation = false;
+			for (int32 i = 0;i < m_RotationNums && !HasValidRotation;++i)
+			{
+				HasValidRotation = m_ValidGridRotationList[GetRotationBitIndex(GridTypeIndex,i)];
+			}
+			m_ValidGridList[GridTypeIndex] = HasValidRotation;
+		}
+
+		// 按字统计置位数跳过整字，在目标字内逐个清除低位后取最低位，得到第 Index 个有效位
 		bool GetGridWithRotationByValidIndex(int32 Index,int32& GridIndex,int32& GridRotation) const
 		{
-			if(Index < 0 || Index >= GetValidGridWithRotationNum())
+			if(Index < 0 || Index >= m_ValidGridRotationNum)
 			{
 				return false;
 			}
-			int32 TargetIndex = 0;
-			for(TConstSetBitIterator<> It(m_ValidGridRotationList);It;++It)
+
+			const uint32* Words = m_ValidGridRotationList.GetData();
+			for (int32 WordIndex = 0;;++WordIndex)
 			{
-				if(Index==0)
+				uint32 Word = Words[WordIndex];
+				const int32 WordBitNum = FMath::CountBits(Word);
+				if (Index >= WordBitNum)
 				{
-					TargetIndex = It.GetIndex();
-					break;
+					Index -= WordBitNum;
+					continue;
+				}
+
+				for (;Index > 0;--Index)
+				{
+					Word &= Word - 1;
 				}
-				Index--;
+				SetGridWithRotationByBitIndex(WordIndex * NumBitsPerDWORD + FMath::CountTrailingZeros(Word),GridIndex,GridRotation);
+				return true;
+			}
+		}
+
+		// 按类型权重选择，同类型的各个旋转权重相同，RandomFraction 取值 [0, 1)
+		bool GetGridWithRotationByWeight(const TArray<float>& GridTypeWeights,float RandomFraction,int32& GridIndex,int32& GridRotation) const
+		{
+			float TotalWeight = 0.0f;
+			for (TConstSetBitIterator<> It(m_ValidGridRotationList);It;++It)
+			{
+				TotalWeight += GridTypeWeights[It.GetIndex() / m_RotationNums];
+			}
+
+			// 全部权重为 0 时退回均分
+			if (TotalWeight <= 0.0f)
+			{
+				return GetGridWithRotationByValidIndex(FMath::Min(FMath::FloorToInt(RandomFraction * m_ValidGridRotationNum),m_ValidGridRotationNum - 1),GridIndex,GridRotation);
 			}
 
-			GridIndex = TargetIndex/m_RotationNums;
-			GridRotation = TargetIndex-GridIndex*m_RotationNums;
+			float Remaining = RandomFraction * TotalWeight;
+			int32 LastIndex = INDEX_NONE;
+			for (TConstSetBitIterator<> It(m_ValidGridRotationList);It;++It)
+			{
+				const float Weight = GridTypeWeights[It.GetIndex() / m_RotationNums];
+				if (Weight <= 0.0f)
+					continue;
+
+				LastIndex = It.GetIndex();
+				if (Remaining < Weight)
+					break;
+				Remaining -= Weight;
+			}
+
+			// 浮点误差落在末尾时取最后一个权重非 0 的候选
+			SetGridWithRotationByBitIndex(LastIndex,GridIndex,GridRotation);
 			return true;
 		}
 		
@@ -170,6 +296,12 @@ class AGridManager : public AActor
 		};
 		
 	private:
+		void SetGridWithRotationByBitIndex(const int32 BitIndex,int32& GridIndex,int32& GridRotation) const
+		{
+			GridIndex = BitIndex/m_RotationNums;
+			GridRotation = BitIndex-GridIndex*m_RotationNums;
+		}
+
 		uint32 GetRotationBitIndex(const int32 GridTypeIndex,const int32 RotationIndex) const
 		{
 			return GridTypeIndex * m_RotationNums + RotationIndex;
@@ -185,11 +317,20 @@ protected:
 	virtual void BeginPlay() override;
 
 public:	
-	// Called every frame
-	virtual void Tick(float DeltaTime) override;
+	// 同一 Seed 结果确定，全部重试仍失败时返回 false 且不生成任何 Grid
+	UFUNCTION(BlueprintCallable,Category = "Grid Manager")
+	bool GenerateGrid(int32 Seed);
+
+	// 只求解并写入 GridPlacements，不创建 Actor 或组件
+	UFUNCTION(BlueprintCallable,Category = "Grid Manager")
+	bool SolveGridPlacements(int32 Seed);
+
+	// 按 OutputMode 把 GridPlacements 输出到场景，之前的输出会被清除
+	UFUNCTION(BlueprintCallable,Category = "Grid Manager")
+	void CommitGridPlacements();
 
 	UFUNCTION(BlueprintCallable,Category = "Grid Manager")
-	void GenerateGrid(int32 Seed);
+	void ClearGrids();
 
 	// 根据已有 Grid 信息，更新指定 GridStatus 对象，剔除不可生成对象
 	UFUNCTION(BlueprintCallable,Category = "Grid Manager")
@@ -207,12 +348,117 @@ public:
 	UPROPERTY(EditAnywhere,BlueprintReadWrite,Category = "Grid Map Settings")
 	TArray<TSubclassOf<AGrid>> GridClasses;
 
+	UPROPERTY(EditAnywhere,BlueprintReadWrite,Category = "Grid Map Settings")
+	EGridOutputMode OutputMode = EGridOutputMode::InstancedMeshes;
+
+	// 最近一次成功求解的结果，按 X * Y_Size + Y 排列
+	UPROPERTY(VisibleInstanceOnly,BlueprintReadOnly,Category = "Grid Manager")
+	TArray<FGridPlacement> GridPlacements;
+
+	// 单次尝试中允许的最大回溯次数，超过后换起点重新开始
+	UPROPERTY(EditAnywhere,BlueprintReadWrite,Category = "Grid Map Settings",meta = (ClampMin = "0"))
+	int32 MaxBacktracks = 256;
+
+	// 回溯耗尽后的最大重新开始次数
+	UPROPERTY(EditAnywhere,BlueprintReadWrite,Category = "Grid Map Settings",meta = (ClampMin = "0"))
+	int32 MaxRestarts = 4;
+
+	// 最近一次生成的统计
+	UPROPERTY(VisibleInstanceOnly,BlueprintReadOnly,Category = "Grid Manager")
+	bool bLastGenerateSucceeded = false;
+
+	UPROPERTY(VisibleInstanceOnly,BlueprintReadOnly,Category = "Grid Manager")
+	int32 LastCollapseNum = 0;
+
+	UPROPERTY(VisibleInstanceOnly,BlueprintReadOnly,Category = "Grid Manager")
+	int32 LastContradictionNum = 0;
+
+	UPROPERTY(VisibleInstanceOnly,BlueprintReadOnly,Category = "Grid Manager")
+	int32 LastBacktrackNum = 0;
+
+	UPROPERTY(VisibleInstanceOnly,BlueprintReadOnly,Category = "Grid Manager")
+	int32 LastRestartNum = 0;
+
 private:
+	// 2D With 4 Direction ; 3D With 6 Direction
+	static constexpr int32 RotationNums = 4;
+	static constexpr int32 DirectionNums = 4;
+	// EGridSlot 共 3 位，掩码取值范围 [0, 8)
+	static constexpr int32 GridSlotMaskNums = 8;
+
+	struct FGridSlotMasks
+	{
+		int32 SelfBitmask = 0;
+		int32 AcceptBitmask = 0;
+	};
+
+	// 每次生成前从 CDO 重建连接表，之后剔除只需一次位集按位与
+	void BuildConnectionTable();
+
 	void InitGridStatuses();
 	static int32 GetOppositeDirectionIndex(const int32 DirectionIndex);
 	int32 GetArrayIndexFromGridLocation(const FIntPoint GridLocation) const;
+	// 越界时返回 INDEX_NONE
+	int32 GetNeighborArrayIndex(const int32 ArrayIndex,const int32 DirectionIndex) const;
+
+	// 一次完整的求解尝试，失败时 GridStatuses 停留在失败时的状态
+	bool SolveGrid(FRandomStream& RandomStream);
+	// 从 ArrayIndex 出发把变化传播到所有受影响的格子，出现空格子时返回 false
+	bool PropagateGridStatus(const int32 ArrayIndex);
+	// 撤销最近的选择并排除它，直到传播成功或回溯次数耗尽
+	bool Backtrack();
+	// 本层第一次修改某格子前记录其旧状态
+	void SaveGridStatus(const int32 ArrayIndex);
+	void UndoTrail(const int32 TrailNum);
+	void SpawnGrids();
+	void CommitInstancedMeshes();
+	UHierarchicalInstancedStaticMeshComponent* GetOrCreateMeshComponent(const int32 GridClassIndex);
 	
+
 private:
 	TArray<AGrid*> Grids;
+
+	// InstancedMeshes 模式下每种 AGrid 类对应的 HISM 组件，按 GridClasses 下标排列，重新生成时复用
+	UPROPERTY(Transient)
+	TArray<UHierarchicalInstancedStaticMeshComponent*> GridMeshComponents;
 	TArray<FGridStatus> GridStatuses;
+
+	struct FGridTrailEntry
+	{
+		int32 ArrayIndex;
+		FGridStatus PreviousStatus;
+	};
+
+	struct FGridDecision
+	{
+		int32 ArrayIndex;
+		int32 GridTypeIndex;
+		int32 GridRotation;
+		// 做出选择前 Trail 的长度，撤销时回退到这里
+		int32 TrailNum;
+	};
+
+	// 选择可选情况最小的格子进行塌陷
+	TIndexPriorityQueue<int32,FGridStatus::FStatusPriorityComparator> GridStatusesPriorityQueue;
+
+	// 撤销记录，每个格子在同一 TrailSerial 下只记录一次
+	TArray<FGridTrailEntry> Trail;
+	TArray<FGridDecision> Decisions;
+	TArray<int32> GridStatusTrailSerials;
+	int32 TrailSerial = 0;
+	int32 AttemptBacktrackNum = 0;
+
+	TArray<int32> PropagationStack;
+	TBitArray<> PropagationScratch;
+
+	// 按 ((GridType * RotationNums + Rotation) * DirectionNums + Direction) 展平的 Self/Accept 掩码
+	TArray<FGridSlotMasks> GridSlotMasks;
+
+	// 按 ((Direction * GridSlotMaskNums + AcceptBitmask) * GridSlotMaskNums + SelfBitmask) 展平
+	// 值为：该方向上的邻居掩码为 (Accept, Self) 时仍可连接的 (类型, 旋转) 位集，位序与 FGridStatus 一致
+	TArray<TBitArray<>> CompatibleGridRotations;
+
+	// 每次生成前从 CDO 读取的 SpawnWeight，全部相同时走均分选择
+	TArray<float> GridTypeWeights;
+	bool bUniformGridTypeWeights = true;
 };
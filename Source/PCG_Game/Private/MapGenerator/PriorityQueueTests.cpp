@@ -0,0 +1,133 @@
+﻿#include "PriorityQueueUnique.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FPriorityQueueUniqueTest, "PCG_Game.MapGenerator.PriorityQueue.Unique",
+	EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FPriorityQueueUniqueTest::RunTest(const FString& Parameters)
+{
+	TPriorityQueueUnique<FString, int32> BasicOperationTestQueue;
+	BasicOperationTestQueue.Enqueue(TEXT("Apple"), 5);
+	BasicOperationTestQueue.Enqueue(TEXT("Banana"), 3);
+	BasicOperationTestQueue.Enqueue(TEXT("Cherry"), 7);
+
+	TestEqual(TEXT("Num"), BasicOperationTestQueue.Num(), 3);
+	TestTrue(TEXT("Contains all"), BasicOperationTestQueue.Contains(TEXT("Banana")) && BasicOperationTestQueue.Contains(TEXT("Apple")) && BasicOperationTestQueue.Contains(TEXT("Cherry")));
+
+	FString Item;
+	int32 Priority;
+	const TCHAR* ExpectedItems[] = { TEXT("Banana"), TEXT("Apple"), TEXT("Cherry") };
+	const int32 ExpectedPriorities[] = { 3, 5, 7 };
+	for (int32 Index = 0; Index < UE_ARRAY_COUNT(ExpectedItems); Index++)
+	{
+		TestTrue(TEXT("Dequeue"), BasicOperationTestQueue.Dequeue(Item, Priority));
+		TestEqual(TEXT("Dequeue order"), Item, FString(ExpectedItems[Index]));
+		TestEqual(TEXT("Dequeue priority"), Priority, ExpectedPriorities[Index]);
+	}
+	TestTrue(TEXT("Empty after dequeue"), BasicOperationTestQueue.IsEmpty());
+
+	// 重复入队与 UpdatePriority 都会更新优先级
+	TPriorityQueueUnique<FString, int32> UpdateTestQueue;
+	UpdateTestQueue.Enqueue(TEXT("A"), 20);
+	UpdateTestQueue.Enqueue(TEXT("B"), 10);
+	UpdateTestQueue.Enqueue(TEXT("C"), 30);
+	UpdateTestQueue.Enqueue(TEXT("C"), 25);
+	TestTrue(TEXT("Update existing"), UpdateTestQueue.UpdatePriority(TEXT("B"), 5));
+	TestFalse(TEXT("Update missing"), UpdateTestQueue.UpdatePriority(TEXT("D"), 1));
+
+	UpdateTestQueue.Dequeue(Item, Priority);
+	TestTrue(TEXT("Decreased priority first"), Item == TEXT("B") && Priority == 5);
+
+	UpdateTestQueue.UpdatePriority(TEXT("A"), 35);
+	UpdateTestQueue.Dequeue(Item, Priority);
+	TestTrue(TEXT("Re-enqueued priority"), Item == TEXT("C") && Priority == 25);
+
+	UpdateTestQueue.Dequeue(Item, Priority);
+	TestTrue(TEXT("Increased priority last"), Item == TEXT("A") && Priority == 35);
+	TestTrue(TEXT("Empty after updates"), UpdateTestQueue.IsEmpty());
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FIndexPriorityQueueTest, "PCG_Game.MapGenerator.PriorityQueue.Index",
+	EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FIndexPriorityQueueTest::RunTest(const FString& Parameters)
+{
+	TIndexPriorityQueue<int32> BasicOperationTestQueue(8);
+	BasicOperationTestQueue.Enqueue(4, 5);
+	BasicOperationTestQueue.Enqueue(1, 3);
+	BasicOperationTestQueue.Enqueue(6, 7);
+	BasicOperationTestQueue.Enqueue(6, 2);
+
+	TestEqual(TEXT("Num"), BasicOperationTestQueue.Num(), 3);
+	TestTrue(TEXT("Contains enqueued"), BasicOperationTestQueue.Contains(6));
+	TestFalse(TEXT("Contains missing"), BasicOperationTestQueue.Contains(0));
+	TestFalse(TEXT("Contains out of range"), BasicOperationTestQueue.Contains(8));
+
+	int32 Index;
+	int32 Priority;
+	BasicOperationTestQueue.Dequeue(Index, Priority);
+	TestTrue(TEXT("Re-enqueued priority first"), Index == 6 && Priority == 2);
+	TestFalse(TEXT("Dequeued removed"), BasicOperationTestQueue.Contains(6));
+
+	TestTrue(TEXT("Remove existing"), BasicOperationTestQueue.Remove(1));
+	TestFalse(TEXT("Remove twice"), BasicOperationTestQueue.Remove(1));
+
+	BasicOperationTestQueue.Dequeue(Index, Priority);
+	TestTrue(TEXT("Remaining element"), Index == 4 && Priority == 5);
+	TestTrue(TEXT("Empty"), BasicOperationTestQueue.IsEmpty());
+
+	// 随机入队、更新与删除后，出队顺序必须与排序结果一致
+	constexpr int32 NumIndices = 256;
+	FRandomStream RandomStream(1105);
+	TIndexPriorityQueue<float> RandomTestQueue(NumIndices);
+	TArray<float> Expected;
+	Expected.Init(-1.0f, NumIndices);
+	for (int32 Round = 0; Round < NumIndices * 4; Round++)
+	{
+		const int32 RandomIndex = RandomStream.RandRange(0, NumIndices - 1);
+		if (RandomStream.FRand() < 0.2f)
+		{
+			TestTrue(TEXT("Random remove"), RandomTestQueue.Remove(RandomIndex) == (Expected[RandomIndex] >= 0.0f));
+			Expected[RandomIndex] = -1.0f;
+		}
+		else
+		{
+			Expected[RandomIndex] = RandomStream.FRand();
+			RandomTestQueue.Enqueue(RandomIndex, Expected[RandomIndex]);
+		}
+	}
+
+	TArray<float> ExpectedOrder;
+	for (const float ExpectedPriority : Expected)
+	{
+		if (ExpectedPriority >= 0.0f)
+		{
+			ExpectedOrder.Add(ExpectedPriority);
+		}
+	}
+	ExpectedOrder.Sort();
+
+	TestEqual(TEXT("Random num"), RandomTestQueue.Num(), ExpectedOrder.Num());
+	for (const float ExpectedPriority : ExpectedOrder)
+	{
+		float RandomPriority;
+		if (!TestTrue(TEXT("Random dequeue"), RandomTestQueue.Dequeue(Index, RandomPriority)))
+		{
+			break;
+		}
+		TestEqual(TEXT("Random dequeue order"), RandomPriority, ExpectedPriority);
+		TestEqual(TEXT("Random dequeue index"), Expected[Index], RandomPriority);
+	}
+
+	// Reset 之后旧索引不再在队列中
+	RandomTestQueue.Reset(4);
+	RandomTestQueue.Enqueue(3, 1.0f);
+	TestEqual(TEXT("Num after reset"), RandomTestQueue.Num(), 1);
+	TestFalse(TEXT("Old index after reset"), RandomTestQueue.Contains(NumIndices - 1));
+	return true;
+}
+
+#endif
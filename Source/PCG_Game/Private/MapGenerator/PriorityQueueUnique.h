@@ -4,8 +4,37 @@
 #include "Containers/Array.h"
 #include "Containers/Map.h"
 
-template<typename T,typename PriorityType,typename Compare = std::less<PriorityType>>
-class TPriorityQueueUnique
+// 任意元素类型：用 TMap 记录元素在堆中的下标
+template<typename T>
+struct TPriorityHeapMapPositions
+{
+	TMap<T,int32> HeapIndices;
+
+	const int32* Find(const T& Element) const {return HeapIndices.Find(Element);}
+	void Set(const T& Element,int32 HeapIndex) {HeapIndices.Add(Element,HeapIndex);}
+	void Remove(const T& Element) {HeapIndices.Remove(Element);}
+	void Reset(int32 ExpectedNumElements) {HeapIndices.Empty(ExpectedNumElements);}
+	SIZE_T GetAllocatedSize() const {return HeapIndices.GetAllocatedSize();}
+};
+
+// [0, NumIndices) 内的稠密整数索引：用数组记录堆中下标，INDEX_NONE 表示不在队列中
+struct FPriorityHeapIndexPositions
+{
+	TArray<int32> HeapIndices;
+
+	const int32* Find(int32 Index) const
+	{
+		return HeapIndices.IsValidIndex(Index) && HeapIndices[Index] != INDEX_NONE ? &HeapIndices[Index] : nullptr;
+	}
+	void Set(int32 Index,int32 HeapIndex) {HeapIndices[Index] = HeapIndex;}
+	void Remove(int32 Index) {HeapIndices[Index] = INDEX_NONE;}
+	void Reset(int32 NumIndices) {HeapIndices.Init(INDEX_NONE,NumIndices);}
+	SIZE_T GetAllocatedSize() const {return HeapIndices.GetAllocatedSize();}
+};
+
+// 去重的二叉堆，重复入队即更新优先级；PositionMapType 决定元素到堆下标的映射方式
+template<typename T,typename PriorityType,typename Compare,typename PositionMapType>
+class TPriorityHeap
 {
 	struct FHeapElement
 	{
@@ -20,19 +49,19 @@ class TPriorityQueueUnique
 	};
 
 	TArray<FHeapElement> Heap;
-	TMap<T,int32> ElementToIndexMap;
+	PositionMapType Positions;
 	Compare Comparator;
 
 public:
-	TPriorityQueueUnique(const Compare& InComparator = Compare())
+	explicit TPriorityHeap(const Compare& InComparator = Compare())
 		:Comparator(InComparator)
 	{}
 
 	void Enqueue(const T& Element,const PriorityType& Priority)
 	{
-		if (ElementToIndexMap.Contains(Element))
+		if (const int32* IndexPtr = Positions.Find(Element))
 		{
-			UpdatePriority(Element,Priority);
+			UpdatePriorityInternal(*IndexPtr,Priority);
 		}
 		else
 		{
@@ -74,30 +103,52 @@ public:
 
 	bool Contains(const T& Element) const
 	{
-		return ElementToIndexMap.Contains(Element);
+		return Positions.Find(Element) != nullptr;
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return Heap.GetAllocatedSize() + Positions.GetAllocatedSize();
 	}
 
 	bool UpdatePriority(const T& Element,const PriorityType& NewPriority)
 	{
-		if (const int32* IndexPtr = ElementToIndexMap.Find(Element))
+		if (const int32* IndexPtr = Positions.Find(Element))
+		{
+			UpdatePriorityInternal(*IndexPtr,NewPriority);
+			return true;
+		}
+		return false;
+	}
+
+protected:
+	bool RemoveElement(const T& Element)
+	{
+		if (const int32* IndexPtr = Positions.Find(Element))
 		{
-			UpdatePriorityInternel(*IndexPtr,NewPriority);
+			RemoveAt(*IndexPtr);
 			return true;
 		}
 		return false;
 	}
 
+	void ResetHeap(int32 ExpectedNumElements)
+	{
+		Heap.Reset(ExpectedNumElements);
+		Positions.Reset(ExpectedNumElements);
+	}
+
 private:
 	void AddNewElement(const T& Element,PriorityType Priority)
 	{
 		Heap.Add(FHeapElement(Element,Priority));
 		int32 NewIndex = Heap.Num() -1;
-		ElementToIndexMap.Add(Element,NewIndex);
+		Positions.Set(Element,NewIndex);
 
 		BubbleUp(NewIndex);
 	}
 
-	void UpdatePriorityInternel(int32 Index,PriorityType NewPriority)
+	void UpdatePriorityInternal(int32 Index,PriorityType NewPriority)
 	{
 		const PriorityType OldPriority = Heap[Index].Priority;
 		Heap[Index].Priority = NewPriority;
@@ -124,8 +175,8 @@ private:
 			SwapElements(Index,LastIndex);
 		}
 
-		Heap.RemoveAt(LastIndex);
-		ElementToIndexMap.Remove(RemovedElement);
+		Heap.RemoveAt(LastIndex,EAllowShrinking::No);
+		Positions.Remove(RemovedElement);
 
 		if (Index < Heap.Num())
 		{
@@ -143,12 +194,10 @@ private:
 	
 	void SwapElements(int32 IndexA,int32 IndexB)
 	{
-		FHeapElement Temp = Heap[IndexA];
-		Heap[IndexA] = Heap[IndexB];
-		Heap[IndexB] = Temp;
+		Swap(Heap[IndexA],Heap[IndexB]);
 
-		ElementToIndexMap[Heap[IndexA].Element] = IndexA;
-		ElementToIndexMap[Heap[IndexB].Element] = IndexB;
+		Positions.Set(Heap[IndexA].Element,IndexA);
+		Positions.Set(Heap[IndexB].Element,IndexB);
 	}
 	
 	void BubbleUp(int32 Index)
@@ -204,94 +253,40 @@ private:
 	int32 Parent(int32 Index) const {return (Index-1)/2;}
 	int32 Left(int32 Index) const {return 2*Index+1;}
 	int32 Right(int32 Index) const {return 2*Index+2;}
+};
 
+template<typename T,typename PriorityType,typename Compare = std::less<PriorityType>>
+class TPriorityQueueUnique : public TPriorityHeap<T,PriorityType,Compare,TPriorityHeapMapPositions<T>>
+{
+	using Super = TPriorityHeap<T,PriorityType,Compare,TPriorityHeapMapPositions<T>>;
 
-	static void Test()
-	{
-		TPriorityQueueUnique<FString, int32> BasicOperationTestQueue;
-		TArray<TPair<FString, int32>> TestData = {
-			{"Apple", 5},
-			{"Banana", 3},
-			{"Cherry", 7}
-		};
-
-		for (const auto& Data : TestData)
-		{
-			BasicOperationTestQueue.Enqueue(Data.Key, Data.Value);
-		}
-
-		if (BasicOperationTestQueue.Num() != 3)
-		{
-			UE_LOG(LogTemp, Warning, TEXT("BasicOperationTest 1 Failed"));
-			return;
-		}
-
-		if(!BasicOperationTestQueue.Contains("Banana") ||
-			!BasicOperationTestQueue.Contains("Apple") ||
-			!BasicOperationTestQueue.Contains("Cherry"))
-		{
-			UE_LOG(LogTemp, Warning, TEXT("BasicOperationTest 2 Failed"));
-			return;
-		}
-
-
-		FString Item;
-		int32 Priority;
-		BasicOperationTestQueue.Dequeue(Item, Priority);
-		if (Item != "Banana" || Priority != 3)
-		{
-			UE_LOG(LogTemp, Warning, TEXT("BasicOperationTest 3 Failed"));
-			return;
-		}
-
-		BasicOperationTestQueue.Dequeue(Item, Priority);
-		if (Item != "Apple" || Priority != 5)
-		{
-			UE_LOG(LogTemp, Warning, TEXT("BasicOperationTest 4 Failed"));
-			return;
-		}
-
-		BasicOperationTestQueue.Dequeue(Item, Priority);
-		if (Item != "Cherry" || Priority != 7)
-		{
-			UE_LOG(LogTemp, Warning, TEXT("BasicOperationTest 5 Failed"));
-			return;
-		}
-
-		UE_LOG(LogTemp, Warning, TEXT("BasicOperationTestSuccess"));
-
-
-		TPriorityQueueUnique<FString, int32> UpdateTestQueue;
-
-		UpdateTestQueue.Enqueue("A", 20);
-		UpdateTestQueue.Enqueue("B", 10);
-		UpdateTestQueue.Enqueue("C", 30);
-		UpdateTestQueue.Enqueue("C", 25);
-
-		UpdateTestQueue.UpdatePriority("B", 5);
+public:
+	TPriorityQueueUnique(const Compare& InComparator = Compare())
+		:Super(InComparator)
+	{}
+};
 
-		UpdateTestQueue.Dequeue(Item, Priority);
-		if (Item != "B" || Priority != 5)
-		{
-			UE_LOG(LogTemp, Warning, TEXT("UpdateTest 1 Failed"));
-			return;
-		} 
+// 元素为 [0, NumIndices) 内稠密整数索引（如格子下标）的优先队列，堆中位置用数组记录，不经过哈希
+template<typename PriorityType,typename Compare = std::less<PriorityType>>
+class TIndexPriorityQueue : public TPriorityHeap<int32,PriorityType,Compare,FPriorityHeapIndexPositions>
+{
+	using Super = TPriorityHeap<int32,PriorityType,Compare,FPriorityHeapIndexPositions>;
 
-		UpdateTestQueue.UpdatePriority("A", 35);
-		UpdateTestQueue.Dequeue(Item, Priority);
-		if (Item != "C" || Priority != 25)
-		{
-			UE_LOG(LogTemp, Warning, TEXT("UpdateTest 2 Failed"));
-			return;
-		}
+public:
+	explicit TIndexPriorityQueue(int32 NumIndices = 0,const Compare& InComparator = Compare())
+		:Super(InComparator)
+	{
+		Reset(NumIndices);
+	}
 
-		UpdateTestQueue.Dequeue(Item, Priority);
-		if (Item != "A" || Priority != 35 || !UpdateTestQueue.IsEmpty())
-		{
-			UE_LOG(LogTemp, Warning, TEXT("UpdateTest 3 Failed"));
-			return;
-		}
+	// 清空队列，之后可入队的索引为 [0, NumIndices)
+	void Reset(int32 NumIndices)
+	{
+		this->ResetHeap(NumIndices);
+	}
 
-		UE_LOG(LogTemp, Warning, TEXT("UpdateTestSuccess"));
+	bool Remove(int32 Index)
+	{
+		return this->RemoveElement(Index);
 	}
 };
@@ -0,0 +1,321 @@
+﻿#include "WFCBenchmarkCommandlet.h"
+
+#include "WFCSolver.h"
+#include "GridManager.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+
+namespace
+{
+    struct FWFCBenchmarkResult
+    {
+        FString Generator;
+        FString Mode;
+        int32 Size = 0;
+        int32 NumTiles = 0;
+        int32 Seed = 0;
+        bool bSucceeded = false;
+        double SolveMilliseconds = 0.0;
+        int32 NumCollapses = 0;
+        int64 NumBans = 0;
+        int64 NumPropagationSteps = 0;
+        int32 NumContradictions = 0;
+        int32 NumBacktracks = 0;
+        int32 NumRetries = 0;
+        // 求解期间求解器堆内存的峰值，GridManager 不统计，为 -1
+        int64 PeakSolverBytes = INDEX_NONE;
+    };
+
+    TArray<int32> ParseIntList(const FString& Params, const TCHAR* Key, const TArray<int32>& Default)
+    {
+        FString Value;
+        if (!FParse::Value(*Params, Key, Value, false))
+        {
+            return Default;
+        }
+
+        TArray<FString> Parts;
+        Value.ParseIntoArray(Parts, TEXT(","));
+
+        TArray<int32> Result;
+        for (const FString& Part : Parts)
+        {
+            Result.Add(FCString::Atoi(*Part));
+        }
+        return Result;
+    }
+
+    // 合成规则：每个 Tile 的四条边随机取 NumEdgeTypes 种之一，相对的边类型相同即可相邻
+    // 规则确定且对称，Tile 越多候选越多，但不保证任意尺寸都无矛盾，与手写规则的情况接近
+    TSharedRef<FWFCCompiledRules> MakeSyntheticRules(int32 NumTiles, int32 Seed)
+    {
+        FRandomStream RandomStream(Seed);
+        const int32 NumEdgeTypes = FMath::Max(2, FMath::RoundToInt(FMath::Sqrt(static_cast<float>(NumTiles))));
+
+        const TSharedRef<FWFCCompiledRules> Rules = MakeShared<FWFCCompiledRules>();
+        Rules->NumTiles = NumTiles;
+
+        TArray<int32> Edges;
+        Edges.SetNumUninitialized(NumTiles * FWFCCompiledRules::NumPlanarDirections);
+        for (int32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+        {
+            const FString TileID = FString::Printf(TEXT("T%d"), TileIndex);
+            Rules->TileIDs.Add(TileID);
+            Rules->TileIndexMap.Add(TileID, TileIndex);
+            Rules->SourceIndices.Add(INDEX_NONE);
+            Rules->TileTransforms.Add(0);
+            Rules->Weights.Add(RandomStream.FRandRange(0.5f, 2.0f));
+
+            for (int32 Dir = 0; Dir < FWFCCompiledRules::NumPlanarDirections; Dir++)
+            {
+                Edges[TileIndex * FWFCCompiledRules::NumPlanarDirections + Dir] = RandomStream.RandRange(0, NumEdgeTypes - 1);
+            }
+        }
+        Rules->BuildWeightTables();
+
+        Rules->InitPropagator();
+        for (int32 Dir = 0; Dir < FWFCCompiledRules::NumPlanarDirections; Dir++)
+        {
+            const int32 OppositeDir = FWFCCompiledRules::GetOppositeDirection(Dir);
+            for (int32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+            {
+                for (int32 NeighborTile = 0; NeighborTile < NumTiles; NeighborTile++)
+                {
+                    if (Edges[TileIndex * FWFCCompiledRules::NumPlanarDirections + Dir] == Edges[NeighborTile * FWFCCompiledRules::NumPlanarDirections + OppositeDir])
+                    {
+                        Rules->SetCompatible(TileIndex, NeighborTile, Dir);
+                    }
+                }
+            }
+        }
+        Rules->BuildInitialSupport();
+        return Rules;
+    }
+
+    FWFCBenchmarkResult RunSolverBenchmark(const TSharedRef<FWFCCompiledRules>& Rules, int32 Size, int32 Seed, EWFCPropagatorMode PropagatorMode, EWFCBacktrackMode BacktrackMode)
+    {
+        FWFCSolverSettings Settings;
+        Settings.Width = Size;
+        Settings.Height = Size;
+        Settings.Seed = Seed;
+        Settings.MaxIterations = Size * Size * 4;
+        Settings.PropagatorMode = PropagatorMode;
+        Settings.BacktrackMode = BacktrackMode;
+
+        FWFCSolver Solver(Rules, Settings);
+        const double StartTime = FPlatformTime::Seconds();
+        const EWFCSolveState State = Solver.Run();
+        const double EndTime = FPlatformTime::Seconds();
+
+        const FWFCSolverStats& Stats = Solver.GetStats();
+        FWFCBenchmarkResult Result;
+        Result.Generator = TEXT("WaveFunctionCollapse");
+        Result.Mode = FString::Printf(TEXT("%s/%s"), *UEnum::GetDisplayValueAsText(PropagatorMode).ToString(), *UEnum::GetDisplayValueAsText(BacktrackMode).ToString());
+        Result.Size = Size;
+        Result.NumTiles = Rules->NumTiles;
+        Result.Seed = Seed;
+        Result.bSucceeded = State == EWFCSolveState::Succeeded;
+        Result.SolveMilliseconds = (EndTime - StartTime) * 1000.0;
+        Result.NumCollapses = Stats.NumCollapses;
+        Result.NumBans = Stats.NumBans;
+        Result.NumPropagationSteps = Stats.NumPropagationSteps;
+        Result.NumContradictions = Stats.NumContradictions;
+        Result.NumBacktracks = Stats.NumBacktracks;
+        Result.NumRetries = Stats.NumRetries;
+        Result.PeakSolverBytes = Stats.PeakAllocatedBytes;
+        return Result;
+    }
+
+    FWFCBenchmarkResult RunGridManagerBenchmark(UWorld* World, const TArray<TSubclassOf<AGrid>>& GridClasses, int32 Size, int32 Seed)
+    {
+        FActorSpawnParameters SpawnParameters;
+        SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+        AGridManager* GridManager = World->SpawnActor<AGridManager>(SpawnParameters);
+        GridManager->X_Size = Size;
+        GridManager->Y_Size = Size;
+        GridManager->GridClasses = GridClasses;
+
+        const double StartTime = FPlatformTime::Seconds();
+        const bool bSucceeded = GridManager->SolveGridPlacements(Seed);
+        const double EndTime = FPlatformTime::Seconds();
+
+        FWFCBenchmarkResult Result;
+        Result.Generator = TEXT("GridManager");
+        Result.Mode = TEXT("Default");
+        Result.Size = Size;
+        Result.NumTiles = GridClasses.Num() * 4;
+        Result.Seed = Seed;
+        Result.bSucceeded = bSucceeded;
+        Result.SolveMilliseconds = (EndTime - StartTime) * 1000.0;
+        Result.NumCollapses = GridManager->LastCollapseNum;
+        Result.NumContradictions = GridManager->LastContradictionNum;
+        Result.NumBacktracks = GridManager->LastBacktrackNum;
+        Result.NumRetries = GridManager->LastRestartNum;
+
+        GridManager->Destroy();
+        return Result;
+    }
+
+    FString MakeCsv(const TArray<FWFCBenchmarkResult>& Results)
+    {
+        FString Csv = TEXT("Generator,Mode,Size,NumTiles,Seed,Succeeded,SolveMs,Collapses,Bans,PropagationSteps,Contradictions,Backtracks,Retries,PeakSolverBytes\n");
+        for (const FWFCBenchmarkResult& Result : Results)
+        {
+            Csv += FString::Printf(TEXT("%s,%s,%d,%d,%d,%d,%.3f,%d,%lld,%lld,%d,%d,%d,%lld\n"),
+                                   *Result.Generator, *Result.Mode, Result.Size, Result.NumTiles, Result.Seed, Result.bSucceeded ? 1 : 0,
+                                   Result.SolveMilliseconds, Result.NumCollapses, Result.NumBans, Result.NumPropagationSteps,
+                                   Result.NumContradictions, Result.NumBacktracks, Result.NumRetries, Result.PeakSolverBytes);
+        }
+        return Csv;
+    }
+
+    FString MakeJson(const TArray<FWFCBenchmarkResult>& Results)
+    {
+        TArray<TSharedPtr<FJsonValue>> Entries;
+        for (const FWFCBenchmarkResult& Result : Results)
+        {
+            const TSharedRef<FJsonObject> Entry = MakeShared<FJsonObject>();
+            Entry->SetStringField(TEXT("generator"), Result.Generator);
+            Entry->SetStringField(TEXT("mode"), Result.Mode);
+            Entry->SetNumberField(TEXT("size"), Result.Size);
+            Entry->SetNumberField(TEXT("numTiles"), Result.NumTiles);
+            Entry->SetNumberField(TEXT("seed"), Result.Seed);
+            Entry->SetBoolField(TEXT("succeeded"), Result.bSucceeded);
+            Entry->SetNumberField(TEXT("solveMs"), Result.SolveMilliseconds);
+            Entry->SetNumberField(TEXT("collapses"), Result.NumCollapses);
+            Entry->SetNumberField(TEXT("bans"), Result.NumBans);
+            Entry->SetNumberField(TEXT("propagationSteps"), Result.NumPropagationSteps);
+            Entry->SetNumberField(TEXT("contradictions"), Result.NumContradictions);
+            Entry->SetNumberField(TEXT("backtracks"), Result.NumBacktracks);
+            Entry->SetNumberField(TEXT("retries"), Result.NumRetries);
+            Entry->SetNumberField(TEXT("peakSolverBytes"), Result.PeakSolverBytes);
+            Entries.Add(MakeShared<FJsonValueObject>(Entry));
+        }
+
+        const TSharedRef<FJsonObject> Root = MakeShared<FJsonObject>();
+        Root->SetArrayField(TEXT("results"), Entries);
+
+        FString Json;
+        const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+        FJsonSerializer::Serialize(Root, Writer);
+        return Json;
+    }
+}
+
+UWFCBenchmarkCommandlet::UWFCBenchmarkCommandlet()
+{
+    IsClient = false;
+    IsServer = false;
+    IsEditor = false;
+    LogToConsole = true;
+}
+
+int32 UWFCBenchmarkCommandlet::Main(const FString& Params)
+{
+    const TArray<int32> Sizes = ParseIntList(Params, TEXT("Sizes="), { 16, 32, 64, 128, 256 });
+    const TArray<int32> TileCounts = ParseIntList(Params, TEXT("Tiles="), { 8, 32, 128 });
+
+    int32 NumSeeds = 3;
+    FParse::Value(*Params, TEXT("Seeds="), NumSeeds);
+    NumSeeds = FMath::Max(NumSeeds, 1);
+
+    int32 GridManagerMaxSize = 64;
+    FParse::Value(*Params, TEXT("GridManagerMaxSize="), GridManagerMaxSize);
+
+    FString OutputPrefix = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("WFCBenchmark"), TEXT("Results"));
+    FParse::Value(*Params, TEXT("Output="), OutputPrefix);
+
+    TArray<FWFCBenchmarkResult> Results;
+
+    // 求解核心：每组 (Tile 数, 尺寸, 种子) 对比两种传播方式与两种回溯方式
+    const EWFCPropagatorMode PropagatorModes[] = { EWFCPropagatorMode::Rescan, EWFCPropagatorMode::SupportCount };
+    const EWFCBacktrackMode BacktrackModes[] = { EWFCBacktrackMode::Snapshot, EWFCBacktrackMode::Trail };
+    for (const int32 NumTiles : TileCounts)
+    {
+        if (NumTiles <= 0)
+        {
+            continue;
+        }
+
+        const TSharedRef<FWFCCompiledRules> Rules = MakeSyntheticRules(NumTiles, NumTiles);
+        for (const int32 Size : Sizes)
+        {
+            for (int32 Seed = 0; Seed < NumSeeds; Seed++)
+            {
+                for (const EWFCPropagatorMode PropagatorMode : PropagatorModes)
+                {
+                    for (const EWFCBacktrackMode BacktrackMode : BacktrackModes)
+                    {
+                        const FWFCBenchmarkResult& Result = Results.Add_GetRef(RunSolverBenchmark(Rules, Size, Seed, PropagatorMode, BacktrackMode));
+                        UE_LOG(LogTemp, Display, TEXT("WFC %s %dx%d tiles=%d seed=%d: %s in %.2f ms"), *Result.Mode, Size, Size, NumTiles, Seed,
+                               Result.bSucceeded ? TEXT("succeeded") : TEXT("failed"), Result.SolveMilliseconds);
+                    }
+                }
+            }
+        }
+    }
+
+    // AGridManager 本身是 Actor，这里创建一个临时的游戏世界
+    TArray<TSubclassOf<AGrid>> GridClasses;
+    FString GridClassPaths;
+    if (FParse::Value(*Params, TEXT("GridClasses="), GridClassPaths, false))
+    {
+        TArray<FString> Paths;
+        GridClassPaths.ParseIntoArray(Paths, TEXT("+"));
+        for (const FString& Path : Paths)
+        {
+            if (UClass* GridClass = LoadClass<AGrid>(nullptr, *Path))
+            {
+                GridClasses.Add(GridClass);
+            }
+            else
+            {
+                UE_LOG(LogTemp, Warning, TEXT("Failed to load grid class %s"), *Path);
+            }
+        }
+    }
+    if (GridClasses.Num() == 0)
+    {
+        GridClasses.Add(AGrid::StaticClass());
+    }
+
+    UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+    FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+    WorldContext.SetCurrentWorld(World);
+    World->InitializeActorsForPlay(FURL());
+
+    for (const int32 Size : Sizes)
+    {
+        if (Size > GridManagerMaxSize)
+        {
+            continue;
+        }
+
+        for (int32 Seed = 0; Seed < NumSeeds; Seed++)
+        {
+            const FWFCBenchmarkResult& Result = Results.Add_GetRef(RunGridManagerBenchmark(World, GridClasses, Size, Seed));
+            UE_LOG(LogTemp, Display, TEXT("GridManager %dx%d seed=%d: %d contradictions in %.2f ms"), Size, Size, Seed,
+                   Result.NumContradictions, Result.SolveMilliseconds);
+        }
+    }
+
+    GEngine->DestroyWorldContext(World);
+    World->DestroyWorld(false);
+
+    const bool bWroteCsv = FFileHelper::SaveStringToFile(MakeCsv(Results), *(OutputPrefix + TEXT(".csv")));
+    const bool bWroteJson = FFileHelper::SaveStringToFile(MakeJson(Results), *(OutputPrefix + TEXT(".json")));
+    if (!bWroteCsv || !bWroteJson)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Failed to write benchmark results to %s"), *OutputPrefix);
+        return 1;
+    }
+
+    UE_LOG(LogTemp, Display, TEXT("WFC benchmark wrote %d results to %s.csv/.json"), Results.Num(), *OutputPrefix);
+    return 0;
+}
@@ -0,0 +1,23 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "WFCBenchmarkCommandlet.generated.h"
+
+// 无界面基准测试：UnrealEditor-Cmd PCG_Game -run=WFCBenchmark -nullrhi [参数]
+//   -Sizes=16,32,64,128,256   网格边长
+//   -Tiles=8,32,128           合成规则的 Tile 数
+//   -Seeds=3                  每组参数的种子数
+//   -GridManagerMaxSize=64    AGridManager 只测到该边长（只计求解，不输出到场景）
+//   -GridClasses=/Game/A.A_C+/Game/B.B_C   AGridManager 使用的 AGrid 蓝图类，缺省为 AGrid
+//   -Output=<路径前缀>         结果写入 <前缀>.csv 与 <前缀>.json，缺省为 Saved/WFCBenchmark/Results
+UCLASS()
+class UWFCBenchmarkCommandlet : public UCommandlet
+{
+    GENERATED_BODY()
+
+public:
+    UWFCBenchmarkCommandlet();
+
+    virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,335 @@
+﻿#include "WFCChunkWorld.h"
+
+#include "Async/Async.h"
+#include "Tasks/Task.h"
+#include "Kismet/GameplayStatics.h"
+
+namespace
+{
+    // 与 FWFCCompiledRules 的方向一致：0 上(+X), 1 右(+Y), 2 下(-X), 3 左(-Y)
+    const FIntPoint ChunkOffsets[FWFCCompiledRules::NumPlanarDirections] = {
+        FIntPoint(1, 0), FIntPoint(0, 1), FIntPoint(-1, 0), FIntPoint(0, -1)
+    };
+}
+
+AWFCChunkWorld::AWFCChunkWorld()
+{
+    // 流式加载需要持续 Tick，不生成基类的固定网格
+    PrimaryActorTick.bStartWithTickEnabled = true;
+    bGenerateOnBeginPlay = false;
+    bSolveAsync = true;
+    OutputMode = EWFCOutputMode::InstancedMeshes;
+}
+
+void AWFCChunkWorld::BeginPlay()
+{
+    Super::BeginPlay();
+
+    if (TileCountLimits.Num() > 0 || WalkableTileIDs.Num() > 0)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("WFC chunk world ignores TileCountLimits and WalkableTileIDs, they only apply to a whole map"));
+    }
+
+    SetActorTickEnabled(true);
+}
+
+void AWFCChunkWorld::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    ClearChunks();
+
+    Super::EndPlay(EndPlayReason);
+}
+
+void AWFCChunkWorld::Tick(float DeltaTime)
+{
+    // 有意跳过 AWaveFunctionCollapse::Tick：它只驱动单张网格的求解，没有活动求解器时会关闭 Tick，流式加载随之停止
+    AActor::Tick(DeltaTime);
+
+    UpdateStreaming();
+}
+
+FIntPoint AWFCChunkWorld::GetChunkAtLocation(const FVector& WorldLocation) const
+{
+    const FVector LocalLocation = GetActorTransform().InverseTransformPosition(WorldLocation);
+    const float ChunkWorldSize = ChunkSize * TileSize;
+
+    return FIntPoint(FMath::FloorToInt(LocalLocation.X / ChunkWorldSize), FMath::FloorToInt(LocalLocation.Y / ChunkWorldSize));
+}
+
+int32 AWFCChunkWorld::GetChunkSeed(const FIntPoint& ChunkCoord) const
+{
+    return static_cast<int32>(HashCombine(GetTypeHash(RandomSeed), GetTypeHash(ChunkCoord)));
+}
+
+bool AWFCChunkWorld::IsBaseChunk(const FIntPoint& ChunkCoord)
+{
+    return ((ChunkCoord.X + ChunkCoord.Y) & 1) == 0;
+}
+
+void AWFCChunkWorld::UpdateStreaming()
+{
+    if (!CompiledRules.IsValid() || CompiledRules->NumTiles == 0)
+    {
+        return;
+    }
+
+    const APawn* PlayerPawn = UGameplayStatics::GetPlayerPawn(this, 0);
+    const FIntPoint Center = GetChunkAtLocation(PlayerPawn ? PlayerPawn->GetActorLocation() : GetActorLocation());
+
+    // 加载半径最外圈的非基准块需要再外一圈的基准块提供边界，基准块因此多加载一圈，只求解不生成 Mesh
+    const int32 BaseLoadRadius = LoadRadius + 1;
+    const int32 BaseUnloadRadius = FMath::Max(UnloadRadius, BaseLoadRadius);
+
+    auto GetChunkDistance = [&Center](const FIntPoint& ChunkCoord)
+    {
+        const FIntPoint Delta = ChunkCoord - Center;
+        return FMath::Max(FMath::Abs(Delta.X), FMath::Abs(Delta.Y));
+    };
+
+    TArray<FIntPoint> ChunksToUnload;
+    int32 NumPending = 0;
+    for (TPair<FIntPoint, FWFCChunk>& Pair : Chunks)
+    {
+        FWFCChunk& Chunk = Pair.Value;
+        const int32 Distance = GetChunkDistance(Pair.Key);
+        if (Distance > (IsBaseChunk(Pair.Key) ? BaseUnloadRadius : UnloadRadius))
+        {
+            ChunksToUnload.Add(Pair.Key);
+        }
+        else if (Chunk.PendingSolver.IsValid())
+        {
+            NumPending++;
+        }
+        else if (!Chunk.bCommitted && Distance <= LoadRadius && Chunk.Tiles.Num() == ChunkSize * ChunkSize)
+        {
+            CommitChunk(Pair.Key, Chunk);
+        }
+    }
+
+    for (const FIntPoint& ChunkCoord : ChunksToUnload)
+    {
+        UnloadChunk(ChunkCoord);
+    }
+
+    if (NumPending >= MaxConcurrentChunkSolves)
+    {
+        return;
+    }
+
+    // 由近到远生成，同距离按坐标排序，保证同一路径下生成顺序一致
+    TArray<FIntPoint> ChunksToLoad;
+    for (int32 X = Center.X - BaseLoadRadius; X <= Center.X + BaseLoadRadius; X++)
+    {
+        for (int32 Y = Center.Y - BaseLoadRadius; Y <= Center.Y + BaseLoadRadius; Y++)
+        {
+            const FIntPoint ChunkCoord(X, Y);
+            if (!Chunks.Contains(ChunkCoord) && (IsBaseChunk(ChunkCoord) || GetChunkDistance(ChunkCoord) <= LoadRadius))
+            {
+                ChunksToLoad.Add(ChunkCoord);
+            }
+        }
+    }
+
+    ChunksToLoad.Sort([&Center](const FIntPoint& A, const FIntPoint& B)
+    {
+        const int32 DistA = (A - Center).SizeSquared();
+        const int32 DistB = (B - Center).SizeSquared();
+        if (DistA != DistB)
+        {
+            return DistA < DistB;
+        }
+        return A.X != B.X ? A.X < B.X : A.Y < B.Y;
+    });
+
+    for (const FIntPoint& ChunkCoord : ChunksToLoad)
+    {
+        if (NumPending >= MaxConcurrentChunkSolves)
+        {
+            break;
+        }
+
+        if (CanLaunchChunkSolve(ChunkCoord))
+        {
+            LaunchChunkSolve(ChunkCoord);
+            NumPending++;
+        }
+    }
+}
+
+bool AWFCChunkWorld::CanLaunchChunkSolve(const FIntPoint& ChunkCoord) const
+{
+    if (IsBaseChunk(ChunkCoord))
+    {
+        return true;
+    }
+
+    // 非基准块等四周的基准块都有结果后再开始
+    for (const FIntPoint& Offset : ChunkOffsets)
+    {
+        const FWFCChunk* Neighbor = Chunks.Find(ChunkCoord + Offset);
+        if (!Neighbor || Neighbor->PendingSolver.IsValid())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void AWFCChunkWorld::LaunchChunkSolve(const FIntPoint& ChunkCoord)
+{
+    FWFCSolverSettings Settings = MakeSolverSettings();
+    Settings.Width = ChunkSize;
+    Settings.Height = ChunkSize;
+    // 分块只在平面上展开
+    Settings.Depth = 1;
+    Settings.Seed = GetChunkSeed(ChunkCoord);
+    // 数量上限与可行走连通针对整张地图，无限地图没有对应的范围，按块执行会变成每块各自满足，因此不使用
+    Settings.TileCountConstraints.Empty();
+    Settings.WalkableTiles.Empty();
+
+    TSharedPtr<FWFCSolver> Solver = MakeShared<FWFCSolver>(CompiledRules.ToSharedRef(), Settings);
+    if (!IsBaseChunk(ChunkCoord))
+    {
+        ApplyBorderConstraints(ChunkCoord, *Solver);
+    }
+
+    FWFCChunk& Chunk = Chunks.FindOrAdd(ChunkCoord);
+    Chunk.PendingSolver = Solver;
+
+    TWeakObjectPtr<AWFCChunkWorld> WeakThis(this);
+    UE::Tasks::Launch(UE_SOURCE_LOCATION, [Solver, WeakThis, ChunkCoord]()
+    {
+        Solver->Run();
+
+        AsyncTask(ENamedThreads::GameThread, [Solver, WeakThis, ChunkCoord]()
+        {
+            if (AWFCChunkWorld* This = WeakThis.Get())
+            {
+                This->OnChunkSolved(ChunkCoord, Solver);
+            }
+        });
+    });
+}
+
+void AWFCChunkWorld::ApplyBorderConstraints(const FIntPoint& ChunkCoord, FWFCSolver& Solver) const
+{
+    const int32 Last = ChunkSize - 1;
+
+    for (int32 Dir = 0; Dir < FWFCCompiledRules::NumPlanarDirections; Dir++)
+    {
+        const FIntPoint& Offset = ChunkOffsets[Dir];
+        const FWFCChunk* Neighbor = Chunks.Find(ChunkCoord + Offset);
+        if (!Neighbor || Neighbor->Tiles.Num() != ChunkSize * ChunkSize)
+        {
+            // 基准块本身无解，这一侧没有可用的边界
+            UE_LOG(LogTemp, Warning, TEXT("WFC chunk (%d, %d) has no border from failed chunk (%d, %d), seam may be discontinuous"),
+                   ChunkCoord.X, ChunkCoord.Y, ChunkCoord.X + Offset.X, ChunkCoord.Y + Offset.Y);
+            continue;
+        }
+
+        // 本块朝向 Dir 的边缘格子，与邻块相对边缘的格子一一相邻
+        for (int32 Index = 0; Index < ChunkSize; Index++)
+        {
+            const int32 X = Offset.X > 0 ? Last : (Offset.X < 0 ? 0 : Index);
+            const int32 Y = Offset.Y > 0 ? Last : (Offset.Y < 0 ? 0 : Index);
+            const int32 NeighborX = Offset.X > 0 ? 0 : (Offset.X < 0 ? Last : Index);
+            const int32 NeighborY = Offset.Y > 0 ? 0 : (Offset.Y < 0 ? Last : Index);
+
+            // 编译时已取两侧规则的交集，本格的候选同时被邻块的 Tile 接受
+            const int32 NeighborTile = Neighbor->Tiles[NeighborX * ChunkSize + NeighborY];
+            if (CompiledRules->IsValidTileIndex(NeighborTile))
+            {
+                Solver.SetCellConstraint(X, Y, CompiledRules->GetAllowedTiles(Dir, NeighborTile));
+            }
+        }
+    }
+}
+
+void AWFCChunkWorld::OnChunkSolved(const FIntPoint& ChunkCoord, const TSharedPtr<FWFCSolver>& Solver)
+{
+    // 期间被卸载或重新求解时丢弃结果
+    FWFCChunk* Chunk = Chunks.Find(ChunkCoord);
+    if (!Chunk || Chunk->PendingSolver != Solver)
+    {
+        return;
+    }
+
+    Chunk->PendingSolver.Reset();
+
+    // Mesh 由下一次 UpdateStreaming 按加载半径生成
+    if (Solver->GetState() == EWFCSolveState::Succeeded)
+    {
+        Solver->GetTileGrid(Chunk->Tiles);
+        return;
+    }
+
+    // 不放宽边界重试，否则块的内容会依赖求解顺序；同一种子重新加载也会失败，保留为空块
+    UE_LOG(LogTemp, Error, TEXT("WFC chunk (%d, %d) failed after %d retries, left empty"),
+           ChunkCoord.X, ChunkCoord.Y, Solver->GetStats().NumRetries);
+}
+
+void AWFCChunkWorld::CommitChunk(const FIntPoint& ChunkCoord, FWFCChunk& Chunk)
+{
+    TMap<UStaticMesh*, TArray<FTransform>> InstancesByMesh;
+    for (int32 X = 0; X < ChunkSize; X++)
+    {
+        for (int32 Y = 0; Y < ChunkSize; Y++)
+        {
+            const int32 TileIndex = Chunk.Tiles[X * ChunkSize + Y];
+            if (UStaticMesh* Mesh = GetTileMesh(TileIndex))
+            {
+                InstancesByMesh.FindOrAdd(Mesh).Add(GetTileInstanceTransform(X, Y, 0, TileIndex));
+            }
+        }
+    }
+
+    const FVector ChunkOrigin(ChunkCoord.X * ChunkSize * TileSize, ChunkCoord.Y * ChunkSize * TileSize, 0.0f);
+    for (TPair<UStaticMesh*, TArray<FTransform>>& Pair : InstancesByMesh)
+    {
+        UHierarchicalInstancedStaticMeshComponent* MeshComponent = NewObject<UHierarchicalInstancedStaticMeshComponent>(this);
+        MeshComponent->SetStaticMesh(Pair.Key);
+        MeshComponent->SetupAttachment(RootComponent);
+        MeshComponent->SetRelativeLocation(ChunkOrigin);
+        MeshComponent->RegisterComponent();
+        AddInstanceComponent(MeshComponent);
+        MeshComponent->AddInstances(Pair.Value, false);
+
+        Chunk.MeshComponents.Add(MeshComponent);
+    }
+
+    Chunk.bCommitted = true;
+}
+
+void AWFCChunkWorld::UnloadChunk(const FIntPoint& ChunkCoord)
+{
+    FWFCChunk* Chunk = Chunks.Find(ChunkCoord);
+    if (!Chunk)
+    {
+        return;
+    }
+
+    if (Chunk->PendingSolver.IsValid())
+    {
+        Chunk->PendingSolver->Cancel();
+    }
+
+    for (UHierarchicalInstancedStaticMeshComponent* MeshComponent : Chunk->MeshComponents)
+    {
+        if (IsValid(MeshComponent))
+        {
+            MeshComponent->DestroyComponent();
+        }
+    }
+
+    Chunks.Remove(ChunkCoord);
+}
+
+void AWFCChunkWorld::ClearChunks()
+{
+    TArray<FIntPoint> ChunkCoords;
+    Chunks.GetKeys(ChunkCoords);
+    for (const FIntPoint& ChunkCoord : ChunkCoords)
+    {
+        UnloadChunk(ChunkCoord);
+    }
+}
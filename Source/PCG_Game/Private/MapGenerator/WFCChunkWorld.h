@@ -0,0 +1,86 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "WaveFunctionCollapse.h"
+#include "WFCChunkWorld.generated.h"
+
+USTRUCT()
+struct FWFCChunk
+{
+    GENERATED_BODY()
+
+    // 该块每种 Mesh 一个 HISM 组件，卸载时一并销毁
+    UPROPERTY()
+    TArray<UHierarchicalInstancedStaticMeshComponent*> MeshComponents;
+
+    // 求解结果，按 X * ChunkSize + Y 展平；为空表示尚未完成或求解失败
+    TArray<int32> Tiles;
+
+    TSharedPtr<FWFCSolver> PendingSolver;
+
+    // 已生成 Mesh；加载半径外只为邻块提供边界的基准块不生成
+    bool bCommitted = false;
+};
+
+// 围绕玩家按固定大小分块生成的无限地图
+// 块按棋盘格分为两类：(X + Y) 为偶数的基准块不带约束独立求解，其余块以四周基准块的边缘 Tile 为边界约束
+// 每块以 (RandomSeed, 块坐标) 派生种子在后台求解，内容只取决于种子与坐标，与加载顺序和卸载历史无关
+// 整张地图的全局约束（TileCountLimits、WalkableTileIDs）不适用于分块，求解时忽略
+UCLASS()
+class PCG_GAME_API AWFCChunkWorld : public AWaveFunctionCollapse
+{
+    GENERATED_BODY()
+
+public:
+    AWFCChunkWorld();
+
+protected:
+    virtual void BeginPlay() override;
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+public:
+    virtual void Tick(float DeltaTime) override;
+
+protected:
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Chunks", meta = (ClampMin = "1"))
+    int32 ChunkSize = 16;
+
+    // 以玩家所在块为中心，切比雪夫距离不超过 LoadRadius 的块会被生成
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Chunks", meta = (ClampMin = "0"))
+    int32 LoadRadius = 2;
+
+    // 超过 UnloadRadius 的块被卸载，应不小于 LoadRadius 以免边界处反复加载
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Chunks", meta = (ClampMin = "0"))
+    int32 UnloadRadius = 3;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Chunks", meta = (ClampMin = "1"))
+    int32 MaxConcurrentChunkSolves = 4;
+
+public:
+    UFUNCTION(BlueprintCallable, Category = "WFC|Chunks")
+    void ClearChunks();
+
+    UFUNCTION(BlueprintPure, Category = "WFC|Chunks")
+    FIntPoint GetChunkAtLocation(const FVector& WorldLocation) const;
+
+    UFUNCTION(BlueprintPure, Category = "WFC|Chunks")
+    int32 GetChunkSeed(const FIntPoint& ChunkCoord) const;
+
+    UFUNCTION(BlueprintPure, Category = "WFC|Chunks")
+    int32 GetNumLoadedChunks() const { return Chunks.Num(); }
+
+private:
+    static bool IsBaseChunk(const FIntPoint& ChunkCoord);
+
+    void UpdateStreaming();
+    bool CanLaunchChunkSolve(const FIntPoint& ChunkCoord) const;
+    void LaunchChunkSolve(const FIntPoint& ChunkCoord);
+    void ApplyBorderConstraints(const FIntPoint& ChunkCoord, FWFCSolver& Solver) const;
+    void OnChunkSolved(const FIntPoint& ChunkCoord, const TSharedPtr<FWFCSolver>& Solver);
+    void CommitChunk(const FIntPoint& ChunkCoord, FWFCChunk& Chunk);
+    void UnloadChunk(const FIntPoint& ChunkCoord);
+
+private:
+    UPROPERTY(Transient)
+    TMap<FIntPoint, FWFCChunk> Chunks;
+};
@@ -0,0 +1,242 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+// TileSet 编译后的纯数据表示，求解器内部只使用稠密整数索引
+// 字符串 ID 仅在 Blueprint 边界（编译/查询/生成）使用
+struct FWFCCompiledRules
+{
+    // 方向：0 上(+X), 1 右(+Y), 2 下(-X), 3 左(-Y)，体素网格再加 4 顶(+Z), 5 底(-Z)
+    static constexpr int32 NumPlanarDirections = 4;
+    static constexpr int32 MaxDirections = 6;
+
+    int32 NumDirections = NumPlanarDirections;
+
+    int32 NumTiles = 0;
+
+    // 索引 -> TileID
+    TArray<FString> TileIDs;
+
+    // 索引 -> TileSet 中的源下标
+    TArray<int32> SourceIndices;
+
+    // 索引 -> 相对源 Tile 的 D4 变换，见 ComposeTransforms
+    TArray<uint8> TileTransforms;
+
+    TArray<float> Weights;
+
+    // w * log(w)，以及全部 Tile 的权重和，用于增量维护格子熵
+    TArray<double> WeightLogWeights;
+    double TotalWeight = 0.0;
+    double TotalWeightLogWeight = 0.0;
+
+    // 按 [Direction * NumTiles + NeighborTile] 展平的规则表
+    // 值为：Direction 方向上的邻居为 NeighborTile 时，本格仍然允许的 Tile 位集
+    TArray<TBitArray<>> Propagator;
+
+    // 按 [TileIndex * NumDirections + Direction] 展平
+    // 空白格子中，该方向上支持 TileIndex 的邻居 Tile 数量，AC-4 计数的初值
+    TArray<int32> InitialSupport;
+
+    TMap<FString, int32> TileIndexMap;
+
+    void Reset()
+    {
+        NumTiles = 0;
+        NumDirections = NumPlanarDirections;
+        TileIDs.Reset();
+        SourceIndices.Reset();
+        TileTransforms.Reset();
+        Weights.Reset();
+        WeightLogWeights.Reset();
+        TotalWeight = 0.0;
+        TotalWeightLogWeight = 0.0;
+        Propagator.Reset();
+        InitialSupport.Reset();
+        TileIndexMap.Reset();
+    }
+
+    int32 FindTileIndex(const FString& TileID) const
+    {
+        const int32* IndexPtr = TileIndexMap.Find(TileID);
+        return IndexPtr ? *IndexPtr : INDEX_NONE;
+    }
+
+    bool IsValidTileIndex(int32 TileIndex) const
+    {
+        return TileIndex >= 0 && TileIndex < NumTiles;
+    }
+
+    // Weights 填充完毕后调用
+    void BuildWeightTables()
+    {
+        WeightLogWeights.SetNumUninitialized(NumTiles);
+        TotalWeight = 0.0;
+        TotalWeightLogWeight = 0.0;
+        for (int32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+        {
+            const double Weight = Weights[TileIndex];
+            WeightLogWeights[TileIndex] = Weight * FMath::Loge(Weight);
+            TotalWeight += Weight;
+            TotalWeightLogWeight += WeightLogWeights[TileIndex];
+        }
+    }
+
+    void InitPropagator()
+    {
+        Propagator.Init(TBitArray<>(false, NumTiles), NumDirections * NumTiles);
+    }
+
+    const TBitArray<>& GetAllowedTiles(int32 Direction, int32 NeighborTile) const
+    {
+        return Propagator[Direction * NumTiles + NeighborTile];
+    }
+
+    // TileIndex 是否接受 Direction 方向上的 NeighborTile
+    bool IsCompatible(int32 TileIndex, int32 NeighborTile, int32 Direction) const
+    {
+        return GetAllowedTiles(Direction, NeighborTile)[TileIndex];
+    }
+
+    void SetCompatible(int32 TileIndex, int32 NeighborTile, int32 Direction)
+    {
+        Propagator[Direction * NumTiles + NeighborTile][TileIndex] = true;
+    }
+
+    // 只保留两侧都允许的相邻关系：A 在 Dir 方向接受 B，当且仅当 B 在反方向也接受 A
+    // 求解器内部双向传播本就只认交集；边缘格子只按外侧的固定 Tile 约束时（区域重算、分块接缝）依赖这一性质
+    void SymmetrizePropagator()
+    {
+        for (int32 Dir = 0; Dir < NumDirections; Dir++)
+        {
+            const int32 OppositeDir = GetOppositeDirection(Dir);
+            for (int32 NeighborTile = 0; NeighborTile < NumTiles; NeighborTile++)
+            {
+                TBitArray<>& Allowed = Propagator[Dir * NumTiles + NeighborTile];
+                for (int32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+                {
+                    if (Allowed[TileIndex] && !IsCompatible(NeighborTile, TileIndex, OppositeDir))
+                    {
+                        Allowed[TileIndex] = false;
+                    }
+                }
+            }
+        }
+    }
+
+    static int32 GetOppositeDirection(int32 Direction)
+    {
+        return Direction < NumPlanarDirections ? (Direction + 2) % NumPlanarDirections : Direction ^ 1;
+    }
+
+    // 平面 D4 变换编码为 Rotation + 4 * Mirror：先沿 X 轴镜像（Y 取反），再绕 Z 轴旋转 Rotation 个 90°（+X 转向 +Y）
+    static constexpr int32 NumTransforms = 8;
+
+    static int32 MakeTransform(int32 Rotation, bool bMirrored)
+    {
+        return ((Rotation % 4 + 4) % 4) + (bMirrored ? 4 : 0);
+    }
+
+    static int32 GetTransformRotation(int32 Transform) { return Transform & 3; }
+    static bool IsTransformMirrored(int32 Transform) { return Transform >= 4; }
+
+    // 先应用 B 再应用 A
+    static int32 ComposeTransforms(int32 A, int32 B)
+    {
+        const int32 RotationB = GetTransformRotation(B);
+        return MakeTransform(GetTransformRotation(A) + (IsTransformMirrored(A) ? -RotationB : RotationB), IsTransformMirrored(A) != IsTransformMirrored(B));
+    }
+
+    static int32 InvertTransform(int32 Transform)
+    {
+        // 镜像变换都是自身的逆
+        return IsTransformMirrored(Transform) ? Transform : MakeTransform(-GetTransformRotation(Transform), false);
+    }
+
+    // 上下方向不受平面变换影响
+    static int32 TransformDirection(int32 Transform, int32 Direction)
+    {
+        if (Direction >= NumPlanarDirections)
+        {
+            return Direction;
+        }
+
+        const int32 MirroredDirection = IsTransformMirrored(Transform) ? (NumPlanarDirections - Direction) % NumPlanarDirections : Direction;
+        return (MirroredDirection + GetTransformRotation(Transform)) % NumPlanarDirections;
+    }
+
+    // 二进制缓存的格式版本，字段或编译规则变化时递增，旧缓存随之失效
+    static constexpr int32 SerializationVersion = 2;
+
+    // 读写全部编译结果，TileIndexMap 在读取时由 TileIDs 重建
+    // 读取时版本不符或表大小不一致返回 false，此时内容不可用
+    bool Serialize(FArchive& Ar)
+    {
+        int32 Version = SerializationVersion;
+        Ar << Version;
+        if (Ar.IsLoading() && Version != SerializationVersion)
+        {
+            return false;
+        }
+
+        Ar << NumDirections;
+        Ar << NumTiles;
+        Ar << TileIDs;
+        Ar << SourceIndices;
+        Ar << TileTransforms;
+        Ar << Weights;
+        Ar << WeightLogWeights;
+        Ar << TotalWeight;
+        Ar << TotalWeightLogWeight;
+        Ar << Propagator;
+        Ar << InitialSupport;
+
+        if (Ar.IsError())
+        {
+            return false;
+        }
+
+        if (Ar.IsLoading())
+        {
+            if ((NumDirections != NumPlanarDirections && NumDirections != MaxDirections) || NumTiles < 0
+                || TileIDs.Num() != NumTiles || SourceIndices.Num() != NumTiles || TileTransforms.Num() != NumTiles
+                || Weights.Num() != NumTiles || WeightLogWeights.Num() != NumTiles
+                || Propagator.Num() != NumDirections * NumTiles || InitialSupport.Num() != NumTiles * NumDirections)
+            {
+                return false;
+            }
+
+            for (const TBitArray<>& Allowed : Propagator)
+            {
+                if (Allowed.Num() != NumTiles)
+                {
+                    return false;
+                }
+            }
+
+            TileIndexMap.Reset();
+            for (int32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+            {
+                TileIndexMap.Add(TileIDs[TileIndex], TileIndex);
+            }
+        }
+
+        return true;
+    }
+
+    // Propagator 填充并调用 SymmetrizePropagator 后调用
+    void BuildInitialSupport()
+    {
+        InitialSupport.Init(0, NumTiles * NumDirections);
+        for (int32 Dir = 0; Dir < NumDirections; Dir++)
+        {
+            for (int32 NeighborTile = 0; NeighborTile < NumTiles; NeighborTile++)
+            {
+                for (TConstSetBitIterator<> It(GetAllowedTiles(Dir, NeighborTile)); It; ++It)
+                {
+                    InitialSupport[It.GetIndex() * NumDirections + Dir]++;
+                }
+            }
+        }
+    }
+};
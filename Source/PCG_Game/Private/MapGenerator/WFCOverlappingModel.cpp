@@ -0,0 +1,338 @@
+﻿#include "WFCOverlappingModel.h"
+
+#include "Engine/Texture2D.h"
+#include "Misc/Crc.h"
+
+namespace
+{
+    // 与 FWFCCompiledRules 的方向一致：0 上(+X), 1 右(+Y), 2 下(-X), 3 左(-Y)
+    const FIntPoint PatternOffsets[FWFCCompiledRules::NumPlanarDirections] = {
+        FIntPoint(1, 0), FIntPoint(0, 1), FIntPoint(-1, 0), FIntPoint(0, -1)
+    };
+
+    // 超过后整体清空，样例通常只有少数几张
+    constexpr int32 MaxCachedSamples = 16;
+
+    // 图案按 X * N + Y 展平；旋转方向与 FWFCCompiledRules 的 D4 变换一致（+X 转向 +Y）
+    void RotatePattern(const int32* In, int32 N, int32* Out)
+    {
+        for (int32 X = 0; X < N; X++)
+        {
+            for (int32 Y = 0; Y < N; Y++)
+            {
+                Out[X * N + Y] = In[Y * N + (N - 1 - X)];
+            }
+        }
+    }
+
+    // 沿 X 轴镜像（Y 取反）
+    void MirrorPattern(const int32* In, int32 N, int32* Out)
+    {
+        for (int32 X = 0; X < N; X++)
+        {
+            for (int32 Y = 0; Y < N; Y++)
+            {
+                Out[X * N + Y] = In[X * N + (N - 1 - Y)];
+            }
+        }
+    }
+
+    // Q 放在 P 的 Offset 处时，两者重叠部分是否完全一致
+    bool PatternsAgree(const int32* P, const int32* Q, int32 N, const FIntPoint& Offset)
+    {
+        const int32 MinX = FMath::Max(0, Offset.X);
+        const int32 MaxX = FMath::Min(N, N + Offset.X);
+        const int32 MinY = FMath::Max(0, Offset.Y);
+        const int32 MaxY = FMath::Min(N, N + Offset.Y);
+        for (int32 X = MinX; X < MaxX; X++)
+        {
+            for (int32 Y = MinY; Y < MaxY; Y++)
+            {
+                if (P[X * N + Y] != Q[(X - Offset.X) * N + (Y - Offset.Y)])
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // 键为样例内容与提取参数的哈希，同一桶内再逐项比对
+    TMap<uint32, TArray<TSharedPtr<const FWFCOverlappingPatterns>>>& GetPatternCache()
+    {
+        static TMap<uint32, TArray<TSharedPtr<const FWFCOverlappingPatterns>>> PatternCache;
+        return PatternCache;
+    }
+}
+
+TSharedPtr<const FWFCOverlappingPatterns> FWFCOverlappingPatterns::FindOrBuild(const TArray<int32>& Sample, int32 SampleWidth, int32 SampleHeight,
+                                                                               int32 PatternSize, bool bPeriodicInput, int32 SymmetryVariants)
+{
+    // 缓存不加锁，只在游戏线程编译规则
+    check(IsInGameThread());
+
+    if (SampleWidth <= 0 || SampleHeight <= 0 || Sample.Num() != SampleWidth * SampleHeight)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Overlapping sample size %dx%d does not match %d values"), SampleWidth, SampleHeight, Sample.Num());
+        return nullptr;
+    }
+
+    if (PatternSize <= 0 || (!bPeriodicInput && (SampleWidth < PatternSize || SampleHeight < PatternSize)))
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Overlapping sample %dx%d is too small for pattern size %d"), SampleWidth, SampleHeight, PatternSize);
+        return nullptr;
+    }
+
+    SymmetryVariants = FMath::Clamp(SymmetryVariants, 1, FWFCCompiledRules::NumTransforms);
+
+    uint32 SampleHash = FCrc::MemCrc32(Sample.GetData(), Sample.Num() * sizeof(int32));
+    SampleHash = HashCombine(SampleHash, GetTypeHash(SampleWidth));
+    SampleHash = HashCombine(SampleHash, GetTypeHash(SampleHeight));
+    SampleHash = HashCombine(SampleHash, GetTypeHash(PatternSize));
+    SampleHash = HashCombine(SampleHash, GetTypeHash(bPeriodicInput));
+    SampleHash = HashCombine(SampleHash, GetTypeHash(SymmetryVariants));
+
+    TMap<uint32, TArray<TSharedPtr<const FWFCOverlappingPatterns>>>& PatternCache = GetPatternCache();
+    if (const TArray<TSharedPtr<const FWFCOverlappingPatterns>>* Bucket = PatternCache.Find(SampleHash))
+    {
+        for (const TSharedPtr<const FWFCOverlappingPatterns>& Cached : *Bucket)
+        {
+            if (Cached->SampleWidth == SampleWidth && Cached->SampleHeight == SampleHeight && Cached->PatternSize == PatternSize
+                && Cached->bPeriodicInput == bPeriodicInput && Cached->SymmetryVariants == SymmetryVariants && Cached->Sample == Sample)
+            {
+                return Cached;
+            }
+        }
+    }
+
+    const int32 N = PatternSize;
+    const int32 PatternArea = N * N;
+
+    // 提取图案：相同图案合并，出现次数作为权重
+    TArray<int32> PatternData;
+    TArray<float> Counts;
+    TMap<uint32, TArray<int32, TInlineAllocator<1>>> PatternBuckets;
+
+    TArray<int32> Variants;
+    Variants.SetNumUninitialized(FWFCCompiledRules::NumTransforms * PatternArea);
+
+    const int32 NumOriginsX = bPeriodicInput ? SampleWidth : SampleWidth - N + 1;
+    const int32 NumOriginsY = bPeriodicInput ? SampleHeight : SampleHeight - N + 1;
+    for (int32 OriginX = 0; OriginX < NumOriginsX; OriginX++)
+    {
+        for (int32 OriginY = 0; OriginY < NumOriginsY; OriginY++)
+        {
+            int32* Base = Variants.GetData();
+            for (int32 X = 0; X < N; X++)
+            {
+                for (int32 Y = 0; Y < N; Y++)
+                {
+                    Base[X * N + Y] = Sample[((OriginX + X) % SampleWidth) * SampleHeight + (OriginY + Y) % SampleHeight];
+                }
+            }
+
+            // 偶数项为旋转 0~3 次，奇数项为其镜像
+            for (int32 Variant = 1; Variant < SymmetryVariants; Variant++)
+            {
+                int32* Out = Base + Variant * PatternArea;
+                if (Variant % 2 == 1)
+                {
+                    MirrorPattern(Out - PatternArea, N, Out);
+                }
+                else
+                {
+                    RotatePattern(Out - 2 * PatternArea, N, Out);
+                }
+            }
+
+            for (int32 Variant = 0; Variant < SymmetryVariants; Variant++)
+            {
+                const int32* Pattern = Base + Variant * PatternArea;
+                const uint32 PatternHash = FCrc::MemCrc32(Pattern, PatternArea * sizeof(int32));
+                TArray<int32, TInlineAllocator<1>>& Bucket = PatternBuckets.FindOrAdd(PatternHash);
+
+                int32 PatternIndex = INDEX_NONE;
+                for (const int32 Candidate : Bucket)
+                {
+                    if (FMemory::Memcmp(&PatternData[Candidate * PatternArea], Pattern, PatternArea * sizeof(int32)) == 0)
+                    {
+                        PatternIndex = Candidate;
+                        break;
+                    }
+                }
+
+                if (PatternIndex != INDEX_NONE)
+                {
+                    Counts[PatternIndex] += 1.0f;
+                    continue;
+                }
+
+                Bucket.Add(Counts.Num());
+                PatternData.Append(Pattern, PatternArea);
+                Counts.Add(1.0f);
+            }
+        }
+    }
+
+    const TSharedRef<FWFCOverlappingPatterns> Result = MakeShared<FWFCOverlappingPatterns>();
+    Result->Sample = Sample;
+    Result->SampleWidth = SampleWidth;
+    Result->SampleHeight = SampleHeight;
+    Result->PatternSize = PatternSize;
+    Result->bPeriodicInput = bPeriodicInput;
+    Result->SymmetryVariants = SymmetryVariants;
+
+    const TSharedRef<FWFCCompiledRules> Rules = MakeShared<FWFCCompiledRules>();
+    Rules->NumTiles = Counts.Num();
+    Rules->Weights = MoveTemp(Counts);
+    Rules->SourceIndices.Init(INDEX_NONE, Rules->NumTiles);
+    Rules->TileTransforms.Init(0, Rules->NumTiles);
+    Result->PatternValues.SetNumUninitialized(Rules->NumTiles);
+    for (int32 PatternIndex = 0; PatternIndex < Rules->NumTiles; PatternIndex++)
+    {
+        const FString PatternID = FString::Printf(TEXT("P%d"), PatternIndex);
+        Rules->TileIDs.Add(PatternID);
+        Rules->TileIndexMap.Add(PatternID, PatternIndex);
+        Result->PatternValues[PatternIndex] = PatternData[PatternIndex * PatternArea];
+    }
+    Rules->BuildWeightTables();
+
+    // 相容关系对称：P 在方向 Dir 上接受 Q 等价于 Q 在反方向上接受 P，只需比较上、右两个方向
+    Rules->NumDirections = FWFCCompiledRules::NumPlanarDirections;
+    Rules->InitPropagator();
+    for (int32 Dir = 0; Dir < FWFCCompiledRules::NumPlanarDirections / 2; Dir++)
+    {
+        const int32 OppositeDir = FWFCCompiledRules::GetOppositeDirection(Dir);
+        for (int32 P = 0; P < Rules->NumTiles; P++)
+        {
+            for (int32 Q = 0; Q < Rules->NumTiles; Q++)
+            {
+                if (PatternsAgree(&PatternData[P * PatternArea], &PatternData[Q * PatternArea], N, PatternOffsets[Dir]))
+                {
+                    Rules->SetCompatible(P, Q, Dir);
+                    Rules->SetCompatible(Q, P, OppositeDir);
+                }
+            }
+        }
+    }
+    Rules->BuildInitialSupport();
+    Result->Rules = Rules;
+
+    UE_LOG(LogTemp, Log, TEXT("Overlapping model extracted %d patterns from %dx%d sample"), Rules->NumTiles, SampleWidth, SampleHeight);
+
+    int32 NumCached = 0;
+    for (const TPair<uint32, TArray<TSharedPtr<const FWFCOverlappingPatterns>>>& Pair : PatternCache)
+    {
+        NumCached += Pair.Value.Num();
+    }
+    if (NumCached >= MaxCachedSamples)
+    {
+        PatternCache.Reset();
+    }
+    PatternCache.FindOrAdd(SampleHash).Add(Result);
+
+    return Result;
+}
+
+void FWFCOverlappingPatterns::ClearCache()
+{
+    GetPatternCache().Reset();
+}
+
+void AWFCOverlappingModel::CompileTileSet()
+{
+    TArray<int32> Sample;
+    int32 SampleWidth = 0;
+    int32 SampleHeight = 0;
+    Patterns = ReadSample(Sample, SampleWidth, SampleHeight)
+        ? FWFCOverlappingPatterns::FindOrBuild(Sample, SampleWidth, SampleHeight, PatternSize, bPeriodicInput, SymmetryVariants)
+        : nullptr;
+
+    if (!Patterns.IsValid())
+    {
+        CompiledRules.Reset();
+        return;
+    }
+
+    if (GridDepth > 1)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Overlapping model only learns planar rules, layers of %s are solved independently"), *GetName());
+    }
+
+    CompiledRules = Patterns->Rules;
+
+    // 地图缓存以规则哈希区分来源，这里由样例内容与提取参数决定
+    FSHA1 HashState;
+    HashState.Update(reinterpret_cast<const uint8*>(Sample.GetData()), Sample.Num() * sizeof(int32));
+    for (const int32 Value : { SampleWidth, SampleHeight, PatternSize, static_cast<int32>(bPeriodicInput), SymmetryVariants })
+    {
+        HashState.Update(reinterpret_cast<const uint8*>(&Value), sizeof(Value));
+    }
+    HashState.Final();
+    HashState.GetHash(RulesHash.Hash);
+}
+
+bool AWFCOverlappingModel::ReadSample(TArray<int32>& OutSample, int32& OutWidth, int32& OutHeight)
+{
+    if (!SampleTexture)
+    {
+        OutSample = SampleGrid;
+        OutWidth = SampleGridWidth;
+        OutHeight = SampleGridHeight;
+        return true;
+    }
+
+    // 运行时从平台数据读取像素，纹理需保留 CPU 端数据且未压缩
+    FTexturePlatformData* PlatformData = SampleTexture->GetPlatformData();
+    if (!PlatformData || PlatformData->Mips.Num() == 0 || PlatformData->PixelFormat != PF_B8G8R8A8)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Sample texture %s must be an uncompressed B8G8R8A8 texture"), *SampleTexture->GetName());
+        return false;
+    }
+
+    FTexture2DMipMap& Mip = PlatformData->Mips[0];
+    const FColor* Pixels = static_cast<const FColor*>(Mip.BulkData.LockReadOnly());
+    if (!Pixels)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Sample texture %s has no CPU pixel data"), *SampleTexture->GetName());
+        Mip.BulkData.Unlock();
+        return false;
+    }
+
+    OutWidth = Mip.SizeX;
+    OutHeight = Mip.SizeY;
+    OutSample.SetNumUninitialized(OutWidth * OutHeight);
+
+    // X 对应像素列，Y 对应像素行
+    SamplePalette.Reset();
+    TMap<FColor, int32> ColorIndices;
+    for (int32 X = 0; X < OutWidth; X++)
+    {
+        for (int32 Y = 0; Y < OutHeight; Y++)
+        {
+            const FColor& Color = Pixels[Y * OutWidth + X];
+            const int32* ColorIndex = ColorIndices.Find(Color);
+            OutSample[X * OutHeight + Y] = ColorIndex ? *ColorIndex : ColorIndices.Add(Color, SamplePalette.Add(Color));
+        }
+    }
+
+    Mip.BulkData.Unlock();
+    return true;
+}
+
+UStaticMesh* AWFCOverlappingModel::GetTileMesh(int32 TileIndex) const
+{
+    if (!Patterns.IsValid() || !Patterns->PatternValues.IsValidIndex(TileIndex))
+    {
+        return nullptr;
+    }
+
+    const int32 Value = Patterns->PatternValues[TileIndex];
+    return ValueMeshes.IsValidIndex(Value) ? ValueMeshes[Value] : nullptr;
+}
+
+int32 AWFCOverlappingModel::GetValueAt(int32 X, int32 Y) const
+{
+    const int32 TileIndex = GetTileIndexAt(X, Y);
+    return TileIndex != INDEX_NONE && Patterns.IsValid() && Patterns->PatternValues.IsValidIndex(TileIndex) ? Patterns->PatternValues[TileIndex] : INDEX_NONE;
+}
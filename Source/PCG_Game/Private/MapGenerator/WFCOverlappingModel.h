@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "WaveFunctionCollapse.h"
+#include "WFCOverlappingModel.generated.h"
+
+class UTexture2D;
+
+// 从样例中提取的 N x N 图案及其编译规则，按样例内容哈希缓存，多次生成共享
+struct FWFCOverlappingPatterns
+{
+    TSharedPtr<FWFCCompiledRules> Rules;
+
+    // 图案索引 -> 图案左上角 (0, 0) 处的样例值，即该图案塌陷后格子的输出值
+    TArray<int32> PatternValues;
+
+    // 样例值按 X * SampleHeight + Y 展平，供哈希冲突时逐项比对
+    TArray<int32> Sample;
+    int32 SampleWidth = 0;
+    int32 SampleHeight = 0;
+    int32 PatternSize = 0;
+    bool bPeriodicInput = false;
+    int32 SymmetryVariants = 1;
+
+    // 构建结果可能来自缓存；样例无效时返回 nullptr
+    static TSharedPtr<const FWFCOverlappingPatterns> FindOrBuild(const TArray<int32>& Sample, int32 SampleWidth, int32 SampleHeight,
+                                                                 int32 PatternSize, bool bPeriodicInput, int32 SymmetryVariants);
+
+    static void ClearCache();
+};
+
+// Overlapping 模型：不手写 TileSet 规则，而是从样例图中学习 N x N 图案以及图案间的重叠相容关系
+// 求解仍使用基类的同步/分帧/后台流程，每个格子输出其图案左上角的样例值对应的 Mesh
+UCLASS()
+class PCG_GAME_API AWFCOverlappingModel : public AWaveFunctionCollapse
+{
+    GENERATED_BODY()
+
+protected:
+    // 样例图需为未压缩的 B8G8R8A8（如 UserInterface2D 压缩设置、无 Mip），颜色按首次出现的顺序编号
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Overlapping")
+    UTexture2D* SampleTexture = nullptr;
+
+    // 未设置 SampleTexture 时使用的整数样例，按 X * SampleGridHeight + Y 展平
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Overlapping")
+    TArray<int32> SampleGrid;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Overlapping", meta = (ClampMin = "1"))
+    int32 SampleGridWidth = 0;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Overlapping", meta = (ClampMin = "1"))
+    int32 SampleGridHeight = 0;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Overlapping", meta = (ClampMin = "2", ClampMax = "5"))
+    int32 PatternSize = 3;
+
+    // 样例在边缘处环绕取图案
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Overlapping")
+    bool bPeriodicInput = true;
+
+    // 每个图案额外加入的旋转/镜像变体数，1 表示只用原图案，8 表示完整的 D4 变换
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Overlapping", meta = (ClampMin = "1", ClampMax = "8"))
+    int32 SymmetryVariants = 1;
+
+    // 样例值 -> 输出 Mesh，空或越界的值不生成
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Overlapping")
+    TArray<UStaticMesh*> ValueMeshes;
+
+    // SampleTexture 中出现的颜色，下标即样例值
+    UPROPERTY(VisibleInstanceOnly, BlueprintReadOnly, Category = "WFC Settings|Overlapping")
+    TArray<FColor> SamplePalette;
+
+public:
+    // 返回已塌陷格子的样例值，未塌陷或越界时返回 INDEX_NONE
+    UFUNCTION(BlueprintPure, Category = "WFC|Overlapping")
+    int32 GetValueAt(int32 X, int32 Y) const;
+
+    UFUNCTION(BlueprintPure, Category = "WFC|Overlapping")
+    int32 GetNumPatterns() const { return Patterns.IsValid() ? Patterns->PatternValues.Num() : 0; }
+
+protected:
+    virtual void CompileTileSet() override;
+    virtual UStaticMesh* GetTileMesh(int32 TileIndex) const override;
+
+private:
+    bool ReadSample(TArray<int32>& OutSample, int32& OutWidth, int32& OutHeight);
+
+private:
+    TSharedPtr<const FWFCOverlappingPatterns> Patterns;
+};
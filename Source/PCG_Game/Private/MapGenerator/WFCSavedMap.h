@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/SecureHash.h"
+
+// 已求解地图的存档格式：头部记录种子、规则哈希与尺寸，Tile 索引网格按行程编码
+struct FWFCSavedMap
+{
+    static constexpr uint32 Magic = 0x4D434657; // "WFCM"
+    static constexpr int32 SerializationVersion = 1;
+
+    // 求解实际使用的种子
+    int32 Seed = 0;
+
+    // 生成该地图时 FWFCCompiledRules 对应的内容哈希，不一致时 Tile 索引无意义
+    FSHAHash RulesHash;
+
+    int32 Width = 0;
+    int32 Height = 0;
+    int32 Depth = 1;
+
+    // 按 (X * Height + Y) * Depth + Z 展平，与 AWaveFunctionCollapse 的格子索引一致
+    TArray<int32> Tiles;
+
+    // 读取时格式、版本不符或数据不完整返回 false
+    bool Serialize(FArchive& Ar)
+    {
+        uint32 FileMagic = Magic;
+        int32 Version = SerializationVersion;
+        Ar << FileMagic;
+        Ar << Version;
+        if (Ar.IsLoading() && (FileMagic != Magic || Version != SerializationVersion))
+        {
+            return false;
+        }
+
+        Ar << Seed;
+        Ar << RulesHash;
+        Ar << Width;
+        Ar << Height;
+        Ar << Depth;
+
+        const int64 NumCells = static_cast<int64>(Width) * Height * Depth;
+        if (Ar.IsError() || Width <= 0 || Height <= 0 || Depth <= 0 || NumCells > MAX_int32)
+        {
+            return false;
+        }
+
+        // 每段写入 (长度, Tile 索引 + 1)，均为变长整数；相邻同类 Tile 很多时远小于逐格存储
+        if (Ar.IsSaving())
+        {
+            if (Tiles.Num() != NumCells)
+            {
+                return false;
+            }
+
+            for (int32 RunStart = 0; RunStart < Tiles.Num();)
+            {
+                int32 RunEnd = RunStart + 1;
+                while (RunEnd < Tiles.Num() && Tiles[RunEnd] == Tiles[RunStart])
+                {
+                    RunEnd++;
+                }
+
+                uint32 RunLength = RunEnd - RunStart;
+                uint32 RunValue = Tiles[RunStart] + 1;
+                Ar.SerializeIntPacked(RunLength);
+                Ar.SerializeIntPacked(RunValue);
+                RunStart = RunEnd;
+            }
+        }
+        else
+        {
+            Tiles.Reset(NumCells);
+            while (Tiles.Num() < NumCells)
+            {
+                uint32 RunLength = 0;
+                uint32 RunValue = 0;
+                Ar.SerializeIntPacked(RunLength);
+                Ar.SerializeIntPacked(RunValue);
+                if (Ar.IsError() || RunLength == 0 || RunLength > NumCells - Tiles.Num())
+                {
+                    return false;
+                }
+
+                const int32 TileIndex = static_cast<int32>(RunValue) - 1;
+                for (uint32 Run = 0; Run < RunLength; Run++)
+                {
+                    Tiles.Add(TileIndex);
+                }
+            }
+        }
+
+        return !Ar.IsError();
+    }
+};
@@ -0,0 +1,1203 @@
+﻿#include "WFCSolver.h"
+
+namespace
+{
+    // 与 FWFCCompiledRules 的方向一致：0 上(+X), 1 右(+Y), 2 下(-X), 3 左(-Y), 4 顶(+Z), 5 底(-Z)
+    const FIntVector DirectionOffsets[FWFCCompiledRules::MaxDirections] = {
+        FIntVector(1, 0, 0), FIntVector(0, 1, 0), FIntVector(-1, 0, 0), FIntVector(0, -1, 0), FIntVector(0, 0, 1), FIntVector(0, 0, -1)
+    };
+
+    // Rescan 的邻居访问顺序
+    const FIntVector RescanOffsets[FWFCCompiledRules::MaxDirections] = {
+        FIntVector(0, -1, 0), FIntVector(1, 0, 0), FIntVector(0, 1, 0), FIntVector(-1, 0, 0), FIntVector(0, 0, 1), FIntVector(0, 0, -1)
+    };
+}
+
+FWFCSolver::FWFCSolver(const TSharedRef<const FWFCCompiledRules>& InRules, const FWFCSolverSettings& InSettings)
+    : Rules(InRules)
+    , Settings(InSettings)
+{
+    if (Settings.WalkableTiles.Num() > 0 && Settings.WalkableTiles.Num() != Rules->NumTiles)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("WFC walkable tile set does not match the rules, ignored"));
+        Settings.WalkableTiles.Empty();
+    }
+
+    Settings.TileCountConstraints.RemoveAll([this](const FWFCTileCountConstraint& Constraint)
+    {
+        if (Constraint.Tiles.Num() != Rules->NumTiles)
+        {
+            UE_LOG(LogTemp, Warning, TEXT("WFC tile count constraint does not match the rules, ignored"));
+            return true;
+        }
+        return false;
+    });
+
+    CountConstraintsByTile.SetNum(Rules->NumTiles);
+    for (int32 ConstraintIndex = 0; ConstraintIndex < Settings.TileCountConstraints.Num(); ConstraintIndex++)
+    {
+        for (TConstSetBitIterator<> It(Settings.TileCountConstraints[ConstraintIndex].Tiles); It; ++It)
+        {
+            CountConstraintsByTile[It.GetIndex()].Add(ConstraintIndex);
+        }
+    }
+
+    bHasGlobalConstraints = Settings.TileCountConstraints.Num() > 0 || Settings.WalkableTiles.Num() > 0;
+}
+
+EWFCSolveState FWFCSolver::Run()
+{
+    Begin();
+    while (Step() == EWFCSolveState::Running)
+    {
+    }
+    return SolveState;
+}
+
+void FWFCSolver::Begin()
+{
+    // 重试使用派生种子，同一 Seed 的结果保持确定
+    CurrentSeed = Settings.Seed;
+    CurrentRetry = 0;
+    Stats = FWFCSolverStats();
+    RandomStream.Initialize(CurrentSeed);
+    SolveState = EWFCSolveState::Running;
+    BeginAttempt();
+    UpdatePeakAllocatedSize();
+}
+
+void FWFCSolver::BeginAttempt()
+{
+    ClearTrail();
+    ClearSnapshots();
+    InitializeGrid();
+    CurrentIteration = 0;
+    NumCollapsedCells = 0;
+}
+
+void FWFCSolver::FailAttempt()
+{
+    Stats.NumRetries++;
+    CurrentRetry++;
+    if (CurrentRetry >= Settings.MaxRetries)
+    {
+        SolveState = EWFCSolveState::Failed;
+        return;
+    }
+
+    UE_LOG(LogTemp, Warning, TEXT("WFC restarting, retry %d"), CurrentRetry + 1);
+
+    CurrentSeed += 1000;
+    RandomStream.Initialize(CurrentSeed);
+    BeginAttempt();
+}
+
+EWFCSolveState FWFCSolver::Step()
+{
+    if (SolveState != EWFCSolveState::Running)
+    {
+        return SolveState;
+    }
+
+    StepAttempt();
+
+    // Trail、移除栈等在求解中不收缩，每步结束时采样即可得到峰值
+    UpdatePeakAllocatedSize();
+    return SolveState;
+}
+
+void FWFCSolver::StepAttempt()
+{
+    if (bCancelRequested)
+    {
+        SolveState = EWFCSolveState::Idle;
+        return;
+    }
+
+    if (++CurrentIteration > Settings.MaxIterations)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("WFC reached MaxIterations (%d)"), Settings.MaxIterations);
+        FailAttempt();
+        return;
+    }
+
+    const int32 CellIndex = FindLowestEntropyCell();
+    const bool bGlobalViolation = ViolatesGlobalConstraints();
+    
+    if (CellIndex == INDEX_NONE && !bGlobalViolation)
+    {
+        SolveState = EWFCSolveState::Succeeded;
+        return;
+    }
+    
+    if (bGlobalViolation || Cells[CellIndex].Entropy == 0)
+    {
+        Stats.NumContradictions++;
+        if (bGlobalViolation)
+        {
+            UE_LOG(LogTemp, Verbose, TEXT("Global constraint violated"));
+        }
+        else
+        {
+            const FIntVector Pos = GetCellPosition(CellIndex);
+            UE_LOG(LogTemp, Verbose, TEXT("Contradiction at (%d, %d, %d)"), Pos.X, Pos.Y, Pos.Z);
+        }
+
+        if (Settings.bEnableBacktracking)
+        {
+            const bool bBacktracked = Settings.BacktrackMode == EWFCBacktrackMode::Trail ? UndoLastDecision() : RestoreSnapshot();
+            if (bBacktracked)
+            {
+                Stats.NumBacktracks++;
+                return;
+            }
+            UE_LOG(LogTemp, Warning, TEXT("Cannot backtrack further, restarting"));
+        }
+
+        FailAttempt();
+        return;
+    }
+    
+    // 回溯用
+    const int32 TrailStart = Trail.Num();
+    if (Settings.bEnableBacktracking && Settings.BacktrackMode == EWFCBacktrackMode::Snapshot)
+    {
+        SaveSnapshot(CellIndex);
+    }
+    
+    CollapseCell(CellIndex);
+
+    if (ShouldRecordTrail())
+    {
+        PushDecision(CellIndex, TrailStart);
+    }
+    else if (Settings.bEnableBacktracking && Snapshots.Num() > 0)
+    {
+        Snapshots.Last().LastCollapsedTile = Cells[CellIndex].SelectedTile;
+    }
+
+    PropagateConstraints(CellIndex);
+}
+
+float FWFCSolver::GetProgress() const
+{
+    // 只读原子计数，可在其他线程调用；成功时所有格子都已塌陷
+    const int32 NumCells = Settings.Width * Settings.Height * Settings.Depth;
+    return NumCells > 0 ? static_cast<float>(NumCollapsedCells.load(std::memory_order_relaxed)) / NumCells : 0.0f;
+}
+
+int32 FWFCSolver::GetTileAt(int32 X, int32 Y, int32 Z) const
+{
+    if (!IsValidPosition(X, Y, Z) || !Cells.IsValidIndex(GetCellIndex(X, Y, Z)))
+    {
+        return INDEX_NONE;
+    }
+
+    const FWFCCell& Cell = Cells[GetCellIndex(X, Y, Z)];
+    return Cell.bCollapsed ? Cell.SelectedTile : INDEX_NONE;
+}
+
+void FWFCSolver::GetTileGrid(TArray<int32>& OutTileIndices) const
+{
+    OutTileIndices.SetNumUninitialized(Cells.Num());
+    for (int32 CellIndex = 0; CellIndex < Cells.Num(); CellIndex++)
+    {
+        OutTileIndices[CellIndex] = Cells[CellIndex].bCollapsed ? Cells[CellIndex].SelectedTile : INDEX_NONE;
+    }
+}
+
+SIZE_T FWFCSolver::GetAllocatedSize() const
+{
+    SIZE_T Size = Cells.GetAllocatedSize() + CellNoise.GetAllocatedSize() + DirtyCells.GetAllocatedSize() + DirtyCellFlags.GetAllocatedSize()
+        + EntropyQueue.GetAllocatedSize() + SupportCounts.GetAllocatedSize() + RemovalStack.GetAllocatedSize() + Trail.GetAllocatedSize() + Decisions.GetAllocatedSize()
+        + CountConstraintCandidates.GetAllocatedSize() + WalkableCandidates.GetAllocatedSize() + FloodQueue.GetAllocatedSize();
+
+    // 每个格子的位集大小相同，按格子数计算，不必逐个遍历
+    Size += CellTileBitsBytes * Cells.Num();
+
+    Size += Snapshots.GetAllocatedSize();
+    for (const FWFCSnapshot& Snapshot : Snapshots)
+    {
+        Size += Snapshot.Cells.GetAllocatedSize() + CellTileBitsBytes * Snapshot.Cells.Num();
+    }
+
+    return Size;
+}
+
+void FWFCSolver::UpdatePeakAllocatedSize()
+{
+    Stats.PeakAllocatedBytes = FMath::Max(Stats.PeakAllocatedBytes, static_cast<int64>(GetAllocatedSize()));
+}
+
+bool FWFCSolver::IsValidPosition(int32 X, int32 Y, int32 Z) const
+{
+    return X >= 0 && X < Settings.Width && Y >= 0 && Y < Settings.Height && Z >= 0 && Z < Settings.Depth;
+}
+
+void FWFCSolver::InitializeGrid()
+{
+    const int32 NumCells = Settings.Width * Settings.Height * Settings.Depth;
+
+    Cells.SetNum(NumCells);
+    for (FWFCCell& Cell : Cells)
+    {
+        Cell.bCollapsed = false;
+        Cell.SelectedTile = INDEX_NONE;
+        Cell.PossibleTiles.Init(true, Rules->NumTiles);
+        Cell.Entropy = Rules->NumTiles;
+        Cell.SumWeights = Rules->TotalWeight;
+        Cell.SumWeightLogWeights = Rules->TotalWeightLogWeight;
+    }
+    CellTileBitsBytes = Cells.Num() > 0 ? Cells[0].PossibleTiles.GetAllocatedSize() : 0;
+
+    // 噪声只用于打破熵相同的平局，由种子决定
+    CellNoise.SetNumUninitialized(NumCells);
+    for (float& Noise : CellNoise)
+    {
+        Noise = RandomStream.FRand() * 1e-4f;
+    }
+
+    DirtyCells.Reset();
+    DirtyCellFlags.Init(false, NumCells);
+    // 初始传播会把变化的格子入队，队列需先按本次格子数重置
+    EntropyQueue.Reset(NumCells);
+
+    // 之后的剔除都会增量更新全局约束状态
+    RebuildGlobalConstraintState();
+
+    if (Settings.PropagatorMode == EWFCPropagatorMode::SupportCount)
+    {
+        InitializeSupportCounts();
+    }
+    else
+    {
+        // 与 AC-4 的初始化一致：先剔除没有任何支持的 Tile，再从这些格子传播
+        TArray<FIntVector> CellsToUpdate;
+        BanUnsupportedTiles(CellsToUpdate);
+        if (CellsToUpdate.Num() > 0)
+        {
+            PropagateConstraints(CellsToUpdate);
+        }
+    }
+
+    ApplyCellConstraints();
+
+    RebuildEntropyQueue();
+}
+
+void FWFCSolver::SetCellConstraint(int32 X, int32 Y, int32 Z, const TBitArray<>& AllowedTiles)
+{
+    if (!IsValidPosition(X, Y, Z) || AllowedTiles.Num() != Rules->NumTiles)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Invalid WFC cell constraint at (%d, %d, %d)"), X, Y, Z);
+        return;
+    }
+
+    if (TBitArray<>* Existing = CellConstraints.Find(GetCellIndex(X, Y, Z)))
+    {
+        Existing->CombineWithBitwiseAND(AllowedTiles, EBitwiseOperatorFlags::MaintainSize);
+        return;
+    }
+
+    CellConstraints.Add(GetCellIndex(X, Y, Z), AllowedTiles);
+}
+
+void FWFCSolver::ApplyCellConstraints()
+{
+    // 先剔除所有约束格子中不允许的 Tile（以及上限为 0 的 Tile），再一次性传播
+    TArray<FIntVector> CellsToUpdate;
+    for (const TPair<int32, TBitArray<>>& Constraint : CellConstraints)
+    {
+        AllowedTilesScratch = Cells[Constraint.Key].PossibleTiles;
+        AllowedTilesScratch.CombineWithBitwiseAND(Constraint.Value, EBitwiseOperatorFlags::MaintainSize);
+        AllowedTilesScratch.CombineWithBitwiseXOR(Cells[Constraint.Key].PossibleTiles, EBitwiseOperatorFlags::MaintainSize);
+        for (TConstSetBitIterator<> It(AllowedTilesScratch); It; ++It)
+        {
+            BanTile(Constraint.Key, It.GetIndex());
+        }
+        CellsToUpdate.Add(GetCellPosition(Constraint.Key));
+    }
+
+    EnforceTileCountLimits(CellsToUpdate);
+    if (CellsToUpdate.Num() == 0)
+    {
+        return;
+    }
+
+    if (Settings.PropagatorMode == EWFCPropagatorMode::SupportCount)
+    {
+        PropagateSupportCounts();
+        return;
+    }
+
+    PropagateConstraints(CellsToUpdate);
+}
+
+double FWFCSolver::CalculateCellPriority(int32 CellIndex) const
+{
+    const FWFCCell& Cell = Cells[CellIndex];
+
+    // 矛盾格子排在最前，尽早触发回溯
+    if (Cell.Entropy == 0)
+    {
+        return -1.0;
+    }
+
+    return Cell.GetShannonEntropy() + CellNoise[CellIndex];
+}
+
+void FWFCSolver::RebuildEntropyQueue()
+{
+    EntropyQueue.Reset(Cells.Num());
+    for (int32 CellIndex = 0; CellIndex < Cells.Num(); CellIndex++)
+    {
+        if (!Cells[CellIndex].bCollapsed)
+        {
+            EntropyQueue.Enqueue(CellIndex, CalculateCellPriority(CellIndex));
+        }
+    }
+
+    for (const int32 CellIndex : DirtyCells)
+    {
+        DirtyCellFlags[CellIndex] = false;
+    }
+    DirtyCells.Reset();
+}
+
+void FWFCSolver::MarkCellDirty(int32 CellIndex)
+{
+    if (!DirtyCellFlags[CellIndex])
+    {
+        DirtyCellFlags[CellIndex] = true;
+        DirtyCells.Add(CellIndex);
+    }
+}
+
+void FWFCSolver::RefreshDirtyCells()
+{
+    for (const int32 CellIndex : DirtyCells)
+    {
+        DirtyCellFlags[CellIndex] = false;
+
+        if (!Cells[CellIndex].bCollapsed)
+        {
+            EntropyQueue.Enqueue(CellIndex, CalculateCellPriority(CellIndex));
+        }
+    }
+    DirtyCells.Reset();
+}
+
+void FWFCSolver::InitializeSupportCounts()
+{
+    const int32 NumTiles = Rules->NumTiles;
+    const int32 NumDirections = Rules->NumDirections;
+
+    SupportCounts.SetNumUninitialized(Cells.Num() * NumTiles * NumDirections);
+    RemovalStack.Reset();
+
+    for (int32 CellIndex = 0; CellIndex < Cells.Num(); CellIndex++)
+    {
+        FMemory::Memcpy(&SupportCounts[CellIndex * NumTiles * NumDirections], Rules->InitialSupport.GetData(),
+                        NumTiles * NumDirections * sizeof(int32));
+    }
+
+    // 初始就没有任何支持的 Tile 直接剔除，之后只需处理计数归零
+    TArray<FIntVector> BannedCells;
+    BanUnsupportedTiles(BannedCells);
+
+    PropagateSupportCounts();
+}
+
+void FWFCSolver::BanUnsupportedTiles(TArray<FIntVector>& OutBannedCells)
+{
+    const int32 NumTiles = Rules->NumTiles;
+    const int32 NumDirections = Rules->NumDirections;
+
+    // 大多数规则集每个 Tile 都有支持，此时无需逐格检查
+    if (!Rules->InitialSupport.Contains(0))
+    {
+        return;
+    }
+
+    for (int32 CellIndex = 0; CellIndex < Cells.Num(); CellIndex++)
+    {
+        const FIntVector Pos = GetCellPosition(CellIndex);
+        bool bBanned = false;
+        for (int32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+        {
+            const int32* TileSupport = &Rules->InitialSupport[TileIndex * NumDirections];
+            for (int32 Dir = 0; Dir < NumDirections; Dir++)
+            {
+                const FIntVector NeighborPos = Pos + DirectionOffsets[Dir];
+                if (TileSupport[Dir] == 0 && IsValidPosition(NeighborPos.X, NeighborPos.Y, NeighborPos.Z))
+                {
+                    BanTile(CellIndex, TileIndex);
+                    bBanned = true;
+                    break;
+                }
+            }
+        }
+
+        if (bBanned)
+        {
+            OutBannedCells.Add(Pos);
+        }
+    }
+}
+
+void FWFCSolver::RebuildSupportCounts()
+{
+    const int32 NumTiles = Rules->NumTiles;
+    const int32 NumDirections = Rules->NumDirections;
+
+    // 与逐个剔除后的结果一致：越界方向保持初值，其余方向只统计邻居当前仍可能的 Tile
+    SupportCounts.SetNumUninitialized(Cells.Num() * NumTiles * NumDirections);
+    RemovalStack.Reset();
+
+    for (int32 CellIndex = 0; CellIndex < Cells.Num(); CellIndex++)
+    {
+        const FIntVector Pos = GetCellPosition(CellIndex);
+        int32* CellSupport = &SupportCounts[CellIndex * NumTiles * NumDirections];
+        for (int32 Dir = 0; Dir < NumDirections; Dir++)
+        {
+            const FIntVector NeighborPos = Pos + DirectionOffsets[Dir];
+            const bool bHasNeighbor = IsValidPosition(NeighborPos.X, NeighborPos.Y, NeighborPos.Z);
+            for (int32 TileIndex = 0; TileIndex < NumTiles; TileIndex++)
+            {
+                CellSupport[TileIndex * NumDirections + Dir] = bHasNeighbor ? 0 : Rules->InitialSupport[TileIndex * NumDirections + Dir];
+            }
+        }
+    }
+
+    // 邻居 N 中的每个候选为 Dir 反方向格子 C 中它允许的 Tile 各提供一个支持
+    for (int32 NeighborIndex = 0; NeighborIndex < Cells.Num(); NeighborIndex++)
+    {
+        const FIntVector NeighborPos = GetCellPosition(NeighborIndex);
+        for (int32 Dir = 0; Dir < NumDirections; Dir++)
+        {
+            const FIntVector Pos = NeighborPos - DirectionOffsets[Dir];
+            if (!IsValidPosition(Pos.X, Pos.Y, Pos.Z))
+            {
+                continue;
+            }
+
+            int32* CellSupport = &SupportCounts[GetCellIndex(Pos.X, Pos.Y, Pos.Z) * NumTiles * NumDirections];
+            for (TConstSetBitIterator<> NeighborIt(Cells[NeighborIndex].PossibleTiles); NeighborIt; ++NeighborIt)
+            {
+                for (TConstSetBitIterator<> It(Rules->GetAllowedTiles(Dir, NeighborIt.GetIndex())); It; ++It)
+                {
+                    CellSupport[It.GetIndex() * NumDirections + Dir]++;
+                }
+            }
+        }
+    }
+}
+
+void FWFCSolver::BanTile(int32 CellIndex, int32 TileIndex)
+{
+    FWFCCell& Cell = Cells[CellIndex];
+    if (!Cell.PossibleTiles[TileIndex])
+    {
+        return;
+    }
+
+    Stats.NumBans++;
+    Cell.PossibleTiles[TileIndex] = false;
+    Cell.Entropy--;
+    Cell.SumWeights -= Rules->Weights[TileIndex];
+    Cell.SumWeightLogWeights -= Rules->WeightLogWeights[TileIndex];
+    MarkCellDirty(CellIndex);
+
+    if (bHasGlobalConstraints)
+    {
+        UpdateGlobalConstraintCounts(CellIndex, TileIndex, -1);
+    }
+
+    if (Settings.PropagatorMode == EWFCPropagatorMode::SupportCount)
+    {
+        RemovalStack.Emplace(CellIndex, TileIndex);
+    }
+
+    if (ShouldRecordTrail())
+    {
+        Trail.Emplace(CellIndex, TileIndex);
+    }
+}
+
+void FWFCSolver::PropagateSupportCounts()
+{
+    const int32 NumTiles = Rules->NumTiles;
+    const int32 NumDirections = Rules->NumDirections;
+
+    while (RemovalStack.Num() > 0)
+    {
+        const FWFCTileBan Ban = RemovalStack.Pop(EAllowShrinking::No);
+        Stats.NumPropagationSteps++;
+        const FIntVector BannedPos = GetCellPosition(Ban.CellIndex);
+
+        // 被剔除的 Tile 位于格子 C 的 Dir 方向上，C 中依赖它的 Tile 支持数减一
+        for (int32 Dir = 0; Dir < NumDirections; Dir++)
+        {
+            const FIntVector Pos = BannedPos - DirectionOffsets[Dir];
+            if (!IsValidPosition(Pos.X, Pos.Y, Pos.Z))
+            {
+                continue;
+            }
+
+            const int32 CellIndex = GetCellIndex(Pos.X, Pos.Y, Pos.Z);
+            const FWFCCell& Cell = Cells[CellIndex];
+            int32* CellSupport = &SupportCounts[CellIndex * NumTiles * NumDirections];
+
+            for (TConstSetBitIterator<> It(Rules->GetAllowedTiles(Dir, Ban.TileIndex)); It; ++It)
+            {
+                const int32 TileIndex = It.GetIndex();
+                int32& Support = CellSupport[TileIndex * NumDirections + Dir];
+                Support--;
+                
+                // 与 Rescan 一致，已塌陷的格子不再被修改
+                if (Support == 0 && !Cell.bCollapsed && Cell.PossibleTiles[TileIndex])
+                {
+                    BanTile(CellIndex, TileIndex);
+                }
+            }
+        }
+    }
+}
+
+void FWFCSolver::SaveSnapshot(int32 LastCollapsedCell)
+{
+    // 限制快照数量
+    if (Snapshots.Num() >= Settings.MaxBacktrackSteps)
+    {
+        Snapshots.RemoveAt(0);
+    }
+    
+    FWFCSnapshot& Snapshot = Snapshots.AddDefaulted_GetRef();
+    Snapshot.Cells = Cells;
+    Snapshot.NumCollapsedCells = NumCollapsedCells;
+    Snapshot.LastCollapsedCell = LastCollapsedCell;
+}
+
+bool FWFCSolver::RestoreSnapshot()
+{
+    if (Snapshots.Num() == 0)
+    {
+        return false;
+    }
+    
+    FWFCSnapshot LastSnapshot = Snapshots.Pop();
+    
+    Cells = MoveTemp(LastSnapshot.Cells);
+    NumCollapsedCells = LastSnapshot.NumCollapsedCells;
+    if (Settings.PropagatorMode == EWFCPropagatorMode::SupportCount)
+    {
+        RebuildSupportCounts();
+    }
+    RebuildGlobalConstraintState();
+    RebuildEntropyQueue();
+    
+    // 快照保存于塌陷之前，恢复后剔除导致矛盾的选择
+    const int32 ProblemCell = LastSnapshot.LastCollapsedCell;
+    if (Cells.IsValidIndex(ProblemCell) && LastSnapshot.LastCollapsedTile != INDEX_NONE)
+    {
+        const FWFCCell& Cell = Cells[ProblemCell];
+        
+        if (!Cell.bCollapsed && Cell.PossibleTiles[LastSnapshot.LastCollapsedTile])
+        {
+            BanTile(ProblemCell, LastSnapshot.LastCollapsedTile);
+            PropagateConstraints(ProblemCell);
+            
+            const FIntVector Pos = GetCellPosition(ProblemCell);
+            UE_LOG(LogTemp, Verbose, TEXT("Removed problematic tile from cell (%d, %d, %d), new entropy: %d"), 
+                   Pos.X, Pos.Y, Pos.Z, Cell.Entropy);
+        }
+    }
+    
+    return true;
+}
+
+void FWFCSolver::ClearSnapshots()
+{
+    Snapshots.Empty();
+}
+
+void FWFCSolver::PushDecision(int32 CellIndex, int32 TrailStart)
+{
+    Decisions.Emplace(CellIndex, Cells[CellIndex].SelectedTile, TrailStart);
+
+    // 超出深度的旧决策不再可撤销，其剔除成为永久状态
+    if (Decisions.Num() - FirstUndoableDecision > Settings.MaxBacktrackSteps)
+    {
+        FirstUndoableDecision++;
+    }
+
+    // 不可撤销的前缀占到一半以上时整体丢弃并平移下标，每条记录只被移动常数次
+    const int32 NumDeadTrail = Decisions.IsValidIndex(FirstUndoableDecision) ? Decisions[FirstUndoableDecision].TrailStart : Trail.Num();
+    if (FirstUndoableDecision > 0 && NumDeadTrail * 2 >= Trail.Num())
+    {
+        Trail.RemoveAt(0, NumDeadTrail, EAllowShrinking::No);
+        Decisions.RemoveAt(0, FirstUndoableDecision, EAllowShrinking::No);
+        for (FWFCDecision& Decision : Decisions)
+        {
+            Decision.TrailStart -= NumDeadTrail;
+        }
+        FirstUndoableDecision = 0;
+    }
+}
+
+bool FWFCSolver::UndoLastDecision()
+{
+    if (Decisions.Num() <= FirstUndoableDecision)
+    {
+        return false;
+    }
+
+    const FWFCDecision Decision = Decisions.Pop(EAllowShrinking::No);
+    RevertTrail(Decision.TrailStart);
+
+    FWFCCell& Cell = Cells[Decision.CellIndex];
+    Cell.bCollapsed = false;
+    Cell.SelectedTile = INDEX_NONE;
+    NumCollapsedCells--;
+    UpdateCollapsedCounts(Decision.TileIndex, -1);
+
+    // 剔除导致矛盾的选择，该剔除记入上一层决策，仍可被继续回退
+    BanTile(Decision.CellIndex, Decision.TileIndex);
+    PropagateConstraints(Decision.CellIndex);
+
+    const FIntVector Pos = GetCellPosition(Decision.CellIndex);
+    UE_LOG(LogTemp, Verbose, TEXT("Removed problematic tile from cell (%d, %d, %d), new entropy: %d"), 
+           Pos.X, Pos.Y, Pos.Z, Cell.Entropy);
+    return true;
+}
+
+void FWFCSolver::RevertTrail(int32 TrailStart)
+{
+    const int32 NumTiles = Rules->NumTiles;
+    const int32 NumDirections = Rules->NumDirections;
+    const bool bRestoreSupport = Settings.PropagatorMode == EWFCPropagatorMode::SupportCount;
+
+    // 传播总会把移除栈处理完，因此每条记录对应的计数递减都已发生，逆序加回即可
+    for (int32 TrailIndex = Trail.Num() - 1; TrailIndex >= TrailStart; TrailIndex--)
+    {
+        const FWFCTileBan& Ban = Trail[TrailIndex];
+
+        FWFCCell& BannedCell = Cells[Ban.CellIndex];
+        BannedCell.PossibleTiles[Ban.TileIndex] = true;
+        BannedCell.Entropy++;
+        BannedCell.SumWeights += Rules->Weights[Ban.TileIndex];
+        BannedCell.SumWeightLogWeights += Rules->WeightLogWeights[Ban.TileIndex];
+        MarkCellDirty(Ban.CellIndex);
+
+        if (bHasGlobalConstraints)
+        {
+            UpdateGlobalConstraintCounts(Ban.CellIndex, Ban.TileIndex, 1);
+        }
+
+        if (!bRestoreSupport)
+        {
+            continue;
+        }
+
+        const FIntVector BannedPos = GetCellPosition(Ban.CellIndex);
+        for (int32 Dir = 0; Dir < NumDirections; Dir++)
+        {
+            const FIntVector Pos = BannedPos - DirectionOffsets[Dir];
+            if (!IsValidPosition(Pos.X, Pos.Y, Pos.Z))
+            {
+                continue;
+            }
+
+            int32* CellSupport = &SupportCounts[GetCellIndex(Pos.X, Pos.Y, Pos.Z) * NumTiles * NumDirections];
+            for (TConstSetBitIterator<> It(Rules->GetAllowedTiles(Dir, Ban.TileIndex)); It; ++It)
+            {
+                CellSupport[It.GetIndex() * NumDirections + Dir]++;
+            }
+        }
+    }
+
+    Trail.SetNum(TrailStart, EAllowShrinking::No);
+}
+
+void FWFCSolver::ClearTrail()
+{
+    Trail.Reset();
+    Decisions.Reset();
+    FirstUndoableDecision = 0;
+}
+
+int32 FWFCSolver::FindLowestEntropyCell()
+{
+    RefreshDirtyCells();
+
+    int32 CellIndex;
+    double Priority;
+    if (!EntropyQueue.Peek(CellIndex, Priority))
+    {
+        return INDEX_NONE;
+    }
+    
+    return CellIndex;
+}
+
+void FWFCSolver::CollapseCell(int32 CellIndex)
+{
+    FWFCCell& Cell = Cells[CellIndex];
+    
+    if (Cell.Entropy == 0)
+    {
+        UE_LOG(LogTemp, Error, TEXT("Trying to collapse cell with no possible tiles"));
+        return;
+    }
+
+    const int32 SelectedTile = SelectRandomTile(Cell);
+    EntropyQueue.Remove(CellIndex);
+
+    // 其余候选逐个剔除，以便 AC-4 增量传播和 Trail 记录
+    AllowedTilesScratch = Cell.PossibleTiles;
+    for (TConstSetBitIterator<> It(AllowedTilesScratch); It; ++It)
+    {
+        if (It.GetIndex() != SelectedTile)
+        {
+            BanTile(CellIndex, It.GetIndex());
+        }
+    }
+    
+    Cell.bCollapsed = true;
+    Cell.SelectedTile = SelectedTile;
+    NumCollapsedCells++;
+    Stats.NumCollapses++;
+    UpdateCollapsedCounts(SelectedTile, 1);
+    
+    const FIntVector Pos = GetCellPosition(CellIndex);
+    UE_LOG(LogTemp, Verbose, TEXT("Collapsed cell (%d, %d, %d) to %s"), Pos.X, Pos.Y, Pos.Z, *Rules->TileIDs[SelectedTile]);
+}
+
+void FWFCSolver::PropagateConstraints(int32 CellIndex)
+{
+    TArray<FIntVector> CellsToUpdate;
+    CellsToUpdate.Add(GetCellPosition(CellIndex));
+    EnforceTileCountLimits(CellsToUpdate);
+
+    if (Settings.PropagatorMode == EWFCPropagatorMode::SupportCount)
+    {
+        PropagateSupportCounts();
+        RefreshDirtyCells();
+        return;
+    }
+
+    PropagateConstraints(CellsToUpdate);
+}
+
+void FWFCSolver::PropagateConstraints(TArray<FIntVector>& CellsToUpdate)
+{
+    while (CellsToUpdate.Num() > 0)
+    {
+        FIntVector CurrentPos = CellsToUpdate[0];
+        CellsToUpdate.RemoveAt(0);
+        Stats.NumPropagationSteps++;
+        
+        for (int32 Dir = 0; Dir < Rules->NumDirections; Dir++)
+        {
+            const FIntVector NeighborPos = CurrentPos + RescanOffsets[Dir];
+            if (IsValidPosition(NeighborPos.X, NeighborPos.Y, NeighborPos.Z))
+            {
+                const FWFCCell& NeighborCell = Cells[GetCellIndex(NeighborPos.X, NeighborPos.Y, NeighborPos.Z)];
+                const int32 OldEntropy = NeighborCell.Entropy;
+                UpdateCellPossibilities(NeighborPos);
+                if (NeighborCell.Entropy != OldEntropy)
+                {
+                    CellsToUpdate.AddUnique(NeighborPos);
+                }
+            }
+        }
+    }
+
+    RefreshDirtyCells();
+}
+
+void FWFCSolver::UpdateCellPossibilities(const FIntVector& Pos)
+{
+    const int32 CellIndex = GetCellIndex(Pos.X, Pos.Y, Pos.Z);
+    const FWFCCell& Cell = Cells[CellIndex];
+    
+    if (Cell.bCollapsed)
+    {
+        return;
+    }
+    
+    // 每个方向：邻居所有可能 Tile 的允许位集按字 OR，再与本格按字 AND
+    RemainingTilesScratch = Cell.PossibleTiles;
+    for (int32 Dir = 0; Dir < Rules->NumDirections; Dir++)
+    {
+        const FIntVector NeighborPos = Pos + DirectionOffsets[Dir];
+        if (!IsValidPosition(NeighborPos.X, NeighborPos.Y, NeighborPos.Z))
+        {
+            continue;
+        }
+
+        const FWFCCell& NeighborCell = Cells[GetCellIndex(NeighborPos.X, NeighborPos.Y, NeighborPos.Z)];
+
+        AllowedTilesScratch.Init(false, Rules->NumTiles);
+        for (TConstSetBitIterator<> It(NeighborCell.PossibleTiles); It; ++It)
+        {
+            AllowedTilesScratch.CombineWithBitwiseOR(Rules->GetAllowedTiles(Dir, It.GetIndex()), EBitwiseOperatorFlags::MaintainSize);
+        }
+
+        RemainingTilesScratch.CombineWithBitwiseAND(AllowedTilesScratch, EBitwiseOperatorFlags::MaintainSize);
+    }
+
+    // 差集逐个剔除，使 Trail 能记录本次变化
+    AllowedTilesScratch = Cell.PossibleTiles;
+    AllowedTilesScratch.CombineWithBitwiseXOR(RemainingTilesScratch, EBitwiseOperatorFlags::MaintainSize);
+    for (TConstSetBitIterator<> It(AllowedTilesScratch); It; ++It)
+    {
+        BanTile(CellIndex, It.GetIndex());
+    }
+}
+
+void FWFCSolver::RebuildGlobalConstraintState()
+{
+    if (!bHasGlobalConstraints)
+    {
+        return;
+    }
+
+    const int32 NumConstraints = Settings.TileCountConstraints.Num();
+    CountConstraintCandidates.Init(0, Cells.Num() * NumConstraints);
+    CountConstraintPossibleCells.Init(0, NumConstraints);
+    CountConstraintCollapsedCells.Init(0, NumConstraints);
+
+    const bool bCheckConnectivity = Settings.WalkableTiles.Num() > 0;
+    WalkableCandidates.Init(0, bCheckConnectivity ? Cells.Num() : 0);
+    NumRequiredWalkableCells = 0;
+
+    for (int32 CellIndex = 0; CellIndex < Cells.Num(); CellIndex++)
+    {
+        const FWFCCell& Cell = Cells[CellIndex];
+        int32* CellCandidates = &CountConstraintCandidates[CellIndex * NumConstraints];
+        for (TConstSetBitIterator<> It(Cell.PossibleTiles); It; ++It)
+        {
+            for (const int32 ConstraintIndex : CountConstraintsByTile[It.GetIndex()])
+            {
+                CellCandidates[ConstraintIndex]++;
+            }
+
+            if (bCheckConnectivity && Settings.WalkableTiles[It.GetIndex()])
+            {
+                WalkableCandidates[CellIndex]++;
+            }
+        }
+
+        for (int32 ConstraintIndex = 0; ConstraintIndex < NumConstraints; ConstraintIndex++)
+        {
+            if (CellCandidates[ConstraintIndex] > 0)
+            {
+                CountConstraintPossibleCells[ConstraintIndex]++;
+            }
+        }
+
+        if (Cell.bCollapsed)
+        {
+            UpdateCollapsedCounts(Cell.SelectedTile, 1);
+        }
+
+        if (bCheckConnectivity && IsRequiredWalkable(CellIndex))
+        {
+            NumRequiredWalkableCells++;
+        }
+    }
+
+    bConnectivityDirty = bCheckConnectivity;
+    bConnectivityViolated = false;
+}
+
+void FWFCSolver::UpdateGlobalConstraintCounts(int32 CellIndex, int32 TileIndex, int32 Delta)
+{
+    // Delta 为 -1 表示剔除，+1 表示回溯恢复；调用时格子的候选与 Entropy 已更新
+    const int32 NumConstraints = Settings.TileCountConstraints.Num();
+    for (const int32 ConstraintIndex : CountConstraintsByTile[TileIndex])
+    {
+        int32& Candidates = CountConstraintCandidates[CellIndex * NumConstraints + ConstraintIndex];
+        const int32 OldCandidates = Candidates;
+        Candidates += Delta;
+        if (OldCandidates == 0 || Candidates == 0)
+        {
+            CountConstraintPossibleCells[ConstraintIndex] += Delta;
+        }
+    }
+
+    if (Settings.WalkableTiles.Num() == 0)
+    {
+        return;
+    }
+
+    const int32 Entropy = Cells[CellIndex].Entropy;
+    const int32 OldEntropy = Entropy - Delta;
+    int32& Walkable = WalkableCandidates[CellIndex];
+    const int32 OldWalkable = Walkable;
+    if (Settings.WalkableTiles[TileIndex])
+    {
+        Walkable += Delta;
+    }
+
+    const bool bWasRequired = OldWalkable == OldEntropy && OldEntropy > 0;
+    const bool bIsRequired = IsRequiredWalkable(CellIndex);
+    if (bWasRequired != bIsRequired)
+    {
+        NumRequiredWalkableCells += bIsRequired ? 1 : -1;
+    }
+
+    if (Delta > 0)
+    {
+        bConnectivityDirty = true;
+        return;
+    }
+
+    // 剔除只会让连通性变差，以下情况之外不可能破坏上一次通过的检查，无需重新洪泛：
+    // 离开可行走集合的格子至多只有一个可行走邻居（叶子），或新增的必然可行走格子紧邻另一个必然可行走格子
+    if (OldWalkable > 0 && Walkable == 0 && CountWalkableNeighbors(CellIndex, false) > 1)
+    {
+        bConnectivityDirty = true;
+    }
+    else if (!bWasRequired && bIsRequired && NumRequiredWalkableCells > 1 && CountWalkableNeighbors(CellIndex, true) == 0)
+    {
+        bConnectivityDirty = true;
+    }
+}
+
+void FWFCSolver::UpdateCollapsedCounts(int32 TileIndex, int32 Delta)
+{
+    if (!bHasGlobalConstraints)
+    {
+        return;
+    }
+
+    for (const int32 ConstraintIndex : CountConstraintsByTile[TileIndex])
+    {
+        CountConstraintCollapsedCells[ConstraintIndex] += Delta;
+    }
+}
+
+void FWFCSolver::EnforceTileCountLimits(TArray<FIntVector>& CellsToUpdate)
+{
+    const int32 NumConstraints = Settings.TileCountConstraints.Num();
+    for (int32 ConstraintIndex = 0; ConstraintIndex < NumConstraints; ConstraintIndex++)
+    {
+        // 达到上限且仍有未塌陷格子保留约束内的候选时，把这些候选全部剔除
+        const FWFCTileCountConstraint& Constraint = Settings.TileCountConstraints[ConstraintIndex];
+        const int32 NumCollapsed = CountConstraintCollapsedCells[ConstraintIndex];
+        if (NumCollapsed < Constraint.MaxCount || CountConstraintPossibleCells[ConstraintIndex] <= NumCollapsed)
+        {
+            continue;
+        }
+
+        for (int32 CellIndex = 0; CellIndex < Cells.Num(); CellIndex++)
+        {
+            if (Cells[CellIndex].bCollapsed || CountConstraintCandidates[CellIndex * NumConstraints + ConstraintIndex] == 0)
+            {
+                continue;
+            }
+
+            AllowedTilesScratch = Cells[CellIndex].PossibleTiles;
+            AllowedTilesScratch.CombineWithBitwiseAND(Constraint.Tiles, EBitwiseOperatorFlags::MaintainSize);
+            for (TConstSetBitIterator<> It(AllowedTilesScratch); It; ++It)
+            {
+                BanTile(CellIndex, It.GetIndex());
+            }
+            CellsToUpdate.Add(GetCellPosition(CellIndex));
+        }
+    }
+}
+
+bool FWFCSolver::ViolatesGlobalConstraints()
+{
+    if (!bHasGlobalConstraints)
+    {
+        return false;
+    }
+
+    for (int32 ConstraintIndex = 0; ConstraintIndex < Settings.TileCountConstraints.Num(); ConstraintIndex++)
+    {
+        const FWFCTileCountConstraint& Constraint = Settings.TileCountConstraints[ConstraintIndex];
+        if (CountConstraintCollapsedCells[ConstraintIndex] > Constraint.MaxCount
+            || CountConstraintPossibleCells[ConstraintIndex] < Constraint.MinCount)
+        {
+            return true;
+        }
+    }
+
+    if (bConnectivityDirty)
+    {
+        bConnectivityDirty = false;
+        bConnectivityViolated = !IsWalkableRegionConnected();
+    }
+
+    return bConnectivityViolated;
+}
+
+bool FWFCSolver::IsWalkableRegionConnected()
+{
+    if (NumRequiredWalkableCells <= 1)
+    {
+        return true;
+    }
+
+    int32 StartCell = INDEX_NONE;
+    for (int32 CellIndex = 0; CellIndex < Cells.Num() && StartCell == INDEX_NONE; CellIndex++)
+    {
+        if (IsRequiredWalkable(CellIndex))
+        {
+            StartCell = CellIndex;
+        }
+    }
+
+    // 从一个必然可行走格子出发，沿仍可能可行走的格子洪泛，必须到达所有必然可行走格子
+    FloodVisited.Init(false, Cells.Num());
+    FloodQueue.Reset();
+    FloodQueue.Add(StartCell);
+    FloodVisited[StartCell] = true;
+
+    int32 NumReached = 0;
+    for (int32 QueueIndex = 0; QueueIndex < FloodQueue.Num(); QueueIndex++)
+    {
+        const int32 CellIndex = FloodQueue[QueueIndex];
+        if (IsRequiredWalkable(CellIndex) && ++NumReached == NumRequiredWalkableCells)
+        {
+            return true;
+        }
+
+        const FIntVector Pos = GetCellPosition(CellIndex);
+        for (int32 Dir = 0; Dir < Rules->NumDirections; Dir++)
+        {
+            const FIntVector NeighborPos = Pos + DirectionOffsets[Dir];
+            if (!IsValidPosition(NeighborPos.X, NeighborPos.Y, NeighborPos.Z))
+            {
+                continue;
+            }
+
+            const int32 NeighborIndex = GetCellIndex(NeighborPos.X, NeighborPos.Y, NeighborPos.Z);
+            if (!FloodVisited[NeighborIndex] && WalkableCandidates[NeighborIndex] > 0)
+            {
+                FloodVisited[NeighborIndex] = true;
+                FloodQueue.Add(NeighborIndex);
+            }
+        }
+    }
+
+    return false;
+}
+
+int32 FWFCSolver::CountWalkableNeighbors(int32 CellIndex, bool bRequiredOnly) const
+{
+    int32 NumNeighbors = 0;
+    const FIntVector Pos = GetCellPosition(CellIndex);
+    for (int32 Dir = 0; Dir < Rules->NumDirections; Dir++)
+    {
+        const FIntVector NeighborPos = Pos + DirectionOffsets[Dir];
+        if (!IsValidPosition(NeighborPos.X, NeighborPos.Y, NeighborPos.Z))
+        {
+            continue;
+        }
+
+        const int32 NeighborIndex = GetCellIndex(NeighborPos.X, NeighborPos.Y, NeighborPos.Z);
+        if (bRequiredOnly ? IsRequiredWalkable(NeighborIndex) : WalkableCandidates[NeighborIndex] > 0)
+        {
+            NumNeighbors++;
+        }
+    }
+    return NumNeighbors;
+}
+
+int32 FWFCSolver::SelectRandomTile(const FWFCCell& Cell)
+{
+    const int32 FirstTile = Cell.PossibleTiles.Find(true);
+    if (FirstTile == INDEX_NONE)
+    {
+        return INDEX_NONE;
+    }
+
+    // 权重和由格子增量维护，无需重新累加
+    float RandomValue = RandomStream.FRandRange(0.0f, static_cast<float>(Cell.SumWeights));
+    float CurrentWeight = 0.0f;
+    
+    for (TConstSetBitIterator<> It(Cell.PossibleTiles); It; ++It)
+    {
+        CurrentWeight += Rules->Weights[It.GetIndex()];
+        if (RandomValue <= CurrentWeight)
+        {
+            return It.GetIndex();
+        }
+    }
+
+    return FirstTile;
+}
+
+FWFCSpeculativeSolve::FWFCSpeculativeSolve(const TSharedRef<const FWFCCompiledRules>& InRules, const FWFCSolverSettings& InSettings, int32 NumSolvers)
+{
+    // 每个求解器最多使用 MaxRetries 个种子（步长 1000），按此错开避免重复搜索
+    const int32 SeedStride = 1000 * FMath::Max(InSettings.MaxRetries, 1);
+
+    Solvers.Reserve(NumSolvers);
+    for (int32 SolverIndex = 0; SolverIndex < NumSolvers; SolverIndex++)
+    {
+        FWFCSolverSettings SolverSettings = InSettings;
+        SolverSettings.Seed = InSettings.Seed + SolverIndex * SeedStride;
+        Solvers.Add(MakeShared<FWFCSolver>(InRules, SolverSettings));
+    }
+}
+
+bool FWFCSpeculativeSolve::RunSolver(int32 SolverIndex)
+{
+    if (Solvers[SolverIndex]->Run() == EWFCSolveState::Succeeded)
+    {
+        int32 ExpectedWinner = INDEX_NONE;
+        if (WinnerIndex.compare_exchange_strong(ExpectedWinner, SolverIndex))
+        {
+            for (int32 OtherIndex = 0; OtherIndex < Solvers.Num(); OtherIndex++)
+            {
+                if (OtherIndex != SolverIndex)
+                {
+                    Solvers[OtherIndex]->Cancel();
+                }
+            }
+            NumFinished++;
+            return true;
+        }
+    }
+
+    // 胜者在计数前已写入 WinnerIndex，因此最后结束者看到 INDEX_NONE 即表示全部失败
+    return ++NumFinished == Solvers.Num() && WinnerIndex == INDEX_NONE;
+}
+
+void FWFCSpeculativeSolve::SetCellConstraint(int32 X, int32 Y, int32 Z, const TBitArray<>& AllowedTiles)
+{
+    for (const TSharedPtr<FWFCSolver>& Solver : Solvers)
+    {
+        Solver->SetCellConstraint(X, Y, Z, AllowedTiles);
+    }
+}
+
+void FWFCSpeculativeSolve::Cancel()
+{
+    for (const TSharedPtr<FWFCSolver>& Solver : Solvers)
+    {
+        Solver->Cancel();
+    }
+}
+
+TSharedPtr<FWFCSolver> FWFCSpeculativeSolve::GetWinner() const
+{
+    const int32 Winner = WinnerIndex;
+    return Solvers.IsValidIndex(Winner) ? Solvers[Winner] : nullptr;
+}
+
+float FWFCSpeculativeSolve::GetProgress() const
+{
+    float Progress = 0.0f;
+    for (const TSharedPtr<FWFCSolver>& Solver : Solvers)
+    {
+        Progress = FMath::Max(Progress, Solver->GetProgress());
+    }
+    return Progress;
+}
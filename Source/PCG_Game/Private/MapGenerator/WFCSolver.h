@@ -0,0 +1,296 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "WFCTypes.h"
+#include "WFCCompiledRules.h"
+#include "PriorityQueueUnique.h"
+#include <atomic>
+
+struct FWFCCell
+{
+    // 按编译后的 Tile 索引存储的可能性位集
+    TBitArray<> PossibleTiles;
+    bool bCollapsed = false;
+    int32 SelectedTile = INDEX_NONE;
+    
+    // 候选数量，为 0 表示矛盾
+    int32 Entropy = 0;
+
+    // 候选的 sum(w) 与 sum(w*log(w))，随剔除增量维护
+    double SumWeights = 0.0;
+    double SumWeightLogWeights = 0.0;
+
+    // 加权 Shannon 熵：log(sum(w)) - sum(w*log(w)) / sum(w)
+    double GetShannonEntropy() const
+    {
+        if (Entropy <= 1 || SumWeights <= 0.0)
+        {
+            return 0.0;
+        }
+        return FMath::Loge(SumWeights) - SumWeightLogWeights / SumWeights;
+    }
+};
+
+// 一次 Tile 剔除，用于 AC-4 传播栈与 Trail
+struct FWFCTileBan
+{
+    int32 CellIndex;
+    int32 TileIndex;
+
+    FWFCTileBan(int32 InCellIndex, int32 InTileIndex)
+        : CellIndex(InCellIndex), TileIndex(InTileIndex)
+    {
+    }
+};
+
+// 一次塌陷决策，TrailStart 为决策前 Trail 的长度
+struct FWFCDecision
+{
+    int32 CellIndex;
+    int32 TileIndex;
+    int32 TrailStart;
+
+    FWFCDecision(int32 InCellIndex, int32 InTileIndex, int32 InTrailStart)
+        : CellIndex(InCellIndex), TileIndex(InTileIndex), TrailStart(InTrailStart)
+    {
+    }
+};
+
+struct FWFCSnapshot
+{
+    // AC-4 的支持计数可由 Cells 推出，恢复时重建，不随快照复制
+    TArray<FWFCCell> Cells;
+    int32 NumCollapsedCells = 0;
+    int32 LastCollapsedCell = INDEX_NONE;
+    int32 LastCollapsedTile = INDEX_NONE;
+};
+
+// 全局数量约束：塌陷为 Tiles 中任一 Tile 的格子总数须在 [MinCount, MaxCount] 内
+struct FWFCTileCountConstraint
+{
+    TBitArray<> Tiles;
+    int32 MinCount = 0;
+    int32 MaxCount = MAX_int32;
+};
+
+struct FWFCSolverSettings
+{
+    int32 Width = 10;
+    int32 Height = 10;
+    // 大于 1 时为体素网格，上下方向需要 6 方向规则
+    int32 Depth = 1;
+    int32 Seed = 0;
+    int32 MaxIterations = 1000;
+    int32 MaxRetries = 3;
+    bool bEnableBacktracking = true;
+    int32 MaxBacktrackSteps = 10;
+    EWFCPropagatorMode PropagatorMode = EWFCPropagatorMode::Rescan;
+    EWFCBacktrackMode BacktrackMode = EWFCBacktrackMode::Snapshot;
+
+    // 全局约束在传播过程中增量检查，违反时与矛盾一样触发回溯或重试
+    TArray<FWFCTileCountConstraint> TileCountConstraints;
+
+    // 非空时要求所有可行走格子（塌陷为其中的 Tile）构成一个连通区域
+    TBitArray<> WalkableTiles;
+};
+
+// 一次 Run/Begin 的累计统计，跨重试累加，用于基准测试与调试
+struct FWFCSolverStats
+{
+    int32 NumCollapses = 0;
+    int64 NumBans = 0;
+    // Rescan 为出队的格子数，SupportCount 为处理的剔除记录数
+    int64 NumPropagationSteps = 0;
+    int32 NumContradictions = 0;
+    int32 NumBacktracks = 0;
+    int32 NumRetries = 0;
+    // 每步结束时 GetAllocatedSize 的最大值
+    int64 PeakAllocatedBytes = 0;
+};
+
+// 不依赖任何 UObject 的 WFC 求解核心，输入编译后的规则与种子，输出 Tile 索引网格
+// 单个实例只能被一个线程驱动；Cancel 与 GetProgress 可在其他线程调用
+class FWFCSolver
+{
+public:
+    FWFCSolver(const TSharedRef<const FWFCCompiledRules>& InRules, const FWFCSolverSettings& InSettings);
+
+    // 同步求解到结束
+    EWFCSolveState Run();
+
+    // 分步求解：Begin 之后反复调用 Step，直到返回值不为 Running
+    void Begin();
+    EWFCSolveState Step();
+
+    // 预设约束：格子只允许 AllowedTiles 中的 Tile，多次设置取交集
+    // 须在 Begin/Run 之前设置，每次尝试初始化后统一剔除并只做一次批量传播
+    void SetCellConstraint(int32 X, int32 Y, const TBitArray<>& AllowedTiles) { SetCellConstraint(X, Y, 0, AllowedTiles); }
+    void SetCellConstraint(int32 X, int32 Y, int32 Z, const TBitArray<>& AllowedTiles);
+    void ClearCellConstraints() { CellConstraints.Empty(); }
+
+    void Cancel() { bCancelRequested = true; }
+    bool IsCancelled() const { return bCancelRequested; }
+
+    EWFCSolveState GetState() const { return SolveState; }
+    float GetProgress() const;
+
+    // 最终成功所使用的种子（重试时为派生种子）
+    int32 GetSolvedSeed() const { return CurrentSeed; }
+    int32 GetRetryCount() const { return CurrentRetry; }
+    const FWFCSolverStats& GetStats() const { return Stats; }
+
+    // 求解器当前持有的堆内存（格子、计数、Trail、快照等），不含规则
+    SIZE_T GetAllocatedSize() const;
+
+    int32 GetWidth() const { return Settings.Width; }
+    int32 GetHeight() const { return Settings.Height; }
+    int32 GetDepth() const { return Settings.Depth; }
+    const FWFCCompiledRules& GetRules() const { return *Rules; }
+
+    // 已塌陷格子的 Tile 索引，未塌陷为 INDEX_NONE
+    int32 GetTileAt(int32 X, int32 Y, int32 Z = 0) const;
+    void GetTileGrid(TArray<int32>& OutTileIndices) const;
+
+    // 按 (X * Height + Y) * Depth + Z 展平，Depth 为 1 时与平面网格一致
+    bool IsValidPosition(int32 X, int32 Y, int32 Z = 0) const;
+    int32 GetCellIndex(int32 X, int32 Y, int32 Z = 0) const { return (X * Settings.Height + Y) * Settings.Depth + Z; }
+    FIntVector GetCellPosition(int32 CellIndex) const
+    {
+        const int32 Column = CellIndex / Settings.Depth;
+        return FIntVector(Column / Settings.Height, Column % Settings.Height, CellIndex % Settings.Depth);
+    }
+
+private:
+    void BeginAttempt();
+    void FailAttempt();
+    void StepAttempt();
+    void UpdatePeakAllocatedSize();
+    void InitializeGrid();
+
+    int32 FindLowestEntropyCell();
+    void CollapseCell(int32 CellIndex);
+    void PropagateConstraints(int32 CellIndex);
+    void PropagateConstraints(TArray<FIntVector>& CellsToUpdate);
+    void ApplyCellConstraints();
+    void UpdateCellPossibilities(const FIntVector& Pos);
+    void InitializeSupportCounts();
+    // 剔除朝某个界内邻居没有任何支持的 Tile，两种传播模式初始化时共用
+    void BanUnsupportedTiles(TArray<FIntVector>& OutBannedCells);
+    void RebuildSupportCounts();
+    void BanTile(int32 CellIndex, int32 TileIndex);
+    void PropagateSupportCounts();
+    int32 SelectRandomTile(const FWFCCell& Cell);
+
+    void SaveSnapshot(int32 LastCollapsedCell);
+    bool RestoreSnapshot();
+    void ClearSnapshots();
+
+    bool ShouldRecordTrail() const { return Settings.bEnableBacktracking && Settings.BacktrackMode == EWFCBacktrackMode::Trail; }
+    void PushDecision(int32 CellIndex, int32 TrailStart);
+    bool UndoLastDecision();
+    void RevertTrail(int32 TrailStart);
+    void ClearTrail();
+
+    double CalculateCellPriority(int32 CellIndex) const;
+    void RebuildEntropyQueue();
+    void MarkCellDirty(int32 CellIndex);
+    void RefreshDirtyCells();
+
+    void RebuildGlobalConstraintState();
+    void UpdateGlobalConstraintCounts(int32 CellIndex, int32 TileIndex, int32 Delta);
+    void UpdateCollapsedCounts(int32 TileIndex, int32 Delta);
+    void EnforceTileCountLimits(TArray<FIntVector>& CellsToUpdate);
+    bool ViolatesGlobalConstraints();
+    bool IsWalkableRegionConnected();
+    int32 CountWalkableNeighbors(int32 CellIndex, bool bRequiredOnly) const;
+    bool IsRequiredWalkable(int32 CellIndex) const { return WalkableCandidates[CellIndex] == Cells[CellIndex].Entropy && Cells[CellIndex].Entropy > 0; }
+
+private:
+    TSharedRef<const FWFCCompiledRules> Rules;
+    FWFCSolverSettings Settings;
+
+    TArray<FWFCCell> Cells;
+
+    TMap<int32, TBitArray<>> CellConstraints;
+
+    // UpdateCellPossibilities 复用的临时位集
+    TBitArray<> AllowedTilesScratch;
+    TBitArray<> RemainingTilesScratch;
+
+    // AC-4：按 [(CellIndex * NumTiles + TileIndex) * NumDirections + Direction] 展平的支持计数
+    TArray<int32> SupportCounts;
+    TArray<FWFCTileBan> RemovalStack;
+
+    // Trail 回溯：按时间顺序记录的剔除与决策栈
+    TArray<FWFCTileBan> Trail;
+    TArray<FWFCDecision> Decisions;
+    int32 FirstUndoableDecision = 0;
+
+    TArray<FWFCSnapshot> Snapshots;
+
+    // 未塌陷格子按 Shannon 熵 + 噪声排序，只更新传播中被改动的格子
+    // 优先级用 double：float 精度下噪声会被熵的舍入吞掉，平局时的选择将取决于堆的历史
+    TIndexPriorityQueue<double> EntropyQueue;
+    TArray<float> CellNoise;
+    // 单个格子 PossibleTiles 的堆内存，所有格子相同
+    SIZE_T CellTileBitsBytes = 0;
+    TArray<int32> DirtyCells;
+    TBitArray<> DirtyCellFlags;
+
+    // 全局约束的增量状态，可由 Cells 完整重建
+    bool bHasGlobalConstraints = false;
+    TArray<TArray<int32, TInlineAllocator<2>>> CountConstraintsByTile;
+    // [CellIndex * NumConstraints + Constraint]：格子中仍属于该约束的候选数
+    TArray<int32> CountConstraintCandidates;
+    // 仍可能 / 已经塌陷为约束内 Tile 的格子数
+    TArray<int32> CountConstraintPossibleCells;
+    TArray<int32> CountConstraintCollapsedCells;
+
+    // 每个格子中可行走候选数；候选全部可行走的格子称为必然可行走，必须彼此连通
+    TArray<int32> WalkableCandidates;
+    int32 NumRequiredWalkableCells = 0;
+    bool bConnectivityDirty = false;
+    bool bConnectivityViolated = false;
+    TArray<int32> FloodQueue;
+    TBitArray<> FloodVisited;
+
+    FWFCSolverStats Stats;
+
+    FRandomStream RandomStream;
+    EWFCSolveState SolveState = EWFCSolveState::Idle;
+    int32 CurrentSeed = 0;
+    int32 CurrentRetry = 0;
+    int32 CurrentIteration = 0;
+    std::atomic<int32> NumCollapsedCells{0};
+    std::atomic<bool> bCancelRequested{false};
+};
+
+// 推测式并行求解：同一规则下多个派生种子同时求解，第一个成功的胜出，其余协作取消
+// 求解器 0 使用 Settings.Seed，与串行求解结果一致；各求解器的重试种子互不重叠
+class FWFCSpeculativeSolve
+{
+public:
+    FWFCSpeculativeSolve(const TSharedRef<const FWFCCompiledRules>& InRules, const FWFCSolverSettings& InSettings, int32 NumSolvers);
+
+    // 在调用线程上运行第 SolverIndex 个求解器；返回 true 表示本次调用决定了最终结果（胜出，或最后一个失败）
+    bool RunSolver(int32 SolverIndex);
+
+    // 转发给所有求解器，须在 RunSolver 之前设置
+    void SetCellConstraint(int32 X, int32 Y, int32 Z, const TBitArray<>& AllowedTiles);
+
+    void Cancel();
+
+    int32 Num() const { return Solvers.Num(); }
+
+    // 胜出的求解器，全部失败时为空
+    TSharedPtr<FWFCSolver> GetWinner() const;
+    int32 GetWinnerIndex() const { return WinnerIndex; }
+
+    // 所有求解器中最快的进度
+    float GetProgress() const;
+
+private:
+    TArray<TSharedPtr<FWFCSolver>> Solvers;
+    std::atomic<int32> WinnerIndex{INDEX_NONE};
+    std::atomic<int32> NumFinished{0};
+};
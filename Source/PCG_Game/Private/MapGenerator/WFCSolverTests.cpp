@@ -0,0 +1,313 @@
+﻿#include "WFCSolver.h"
+#include "Misc/AutomationTest.h"
+#include "UObject/Class.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace
+{
+    constexpr int32 TestGridSize = 10;
+    constexpr int32 TestNumTiles = 16;
+    constexpr int32 TestNumEdgeTypes = 4;
+    constexpr int32 NumRuleSeeds = 3;
+    constexpr int32 NumSolveSeeds = 8;
+
+    // 与 FWFCCompiledRules 的方向一致：0 上(+X), 1 右(+Y), 2 下(-X), 3 左(-Y)
+    const FIntPoint TestOffsets[FWFCCompiledRules::NumPlanarDirections] = {
+        FIntPoint(1, 0), FIntPoint(0, 1), FIntPoint(-1, 0), FIntPoint(0, -1)
+    };
+
+    const EWFCPropagatorMode PropagatorModes[] = { EWFCPropagatorMode::Rescan, EWFCPropagatorMode::SupportCount };
+    const EWFCBacktrackMode BacktrackModes[] = { EWFCBacktrackMode::Snapshot, EWFCBacktrackMode::Trail };
+
+    // 合成规则：每个 Tile 的四条边各取一种边类型，相对的边类型相同即可相邻，规则天然对称
+    // 前 NumEdgeTypes 个 Tile 四边同类型，每种边在每个方向上都出现；其余 Tile 随机，求解中会出现矛盾与回溯
+    // bWithUnsupportedTile 时最后一个 Tile 的上边为其他 Tile 下边都没有的类型，只能放在最上一行
+    TSharedRef<FWFCCompiledRules> MakeTestRules(int32 Seed, bool bWithUnsupportedTile = false)
+    {
+        FRandomStream RandomStream(Seed);
+
+        const TSharedRef<FWFCCompiledRules> Rules = MakeShared<FWFCCompiledRules>();
+        Rules->NumTiles = TestNumTiles;
+
+        TArray<int32> Edges;
+        Edges.SetNumUninitialized(TestNumTiles * FWFCCompiledRules::NumPlanarDirections);
+        for (int32 TileIndex = 0; TileIndex < TestNumTiles; TileIndex++)
+        {
+            const FString TileID = FString::Printf(TEXT("T%d"), TileIndex);
+            Rules->TileIDs.Add(TileID);
+            Rules->TileIndexMap.Add(TileID, TileIndex);
+            Rules->SourceIndices.Add(INDEX_NONE);
+            Rules->TileTransforms.Add(0);
+            Rules->Weights.Add(RandomStream.FRandRange(0.5f, 2.0f));
+
+            for (int32 Dir = 0; Dir < FWFCCompiledRules::NumPlanarDirections; Dir++)
+            {
+                Edges[TileIndex * FWFCCompiledRules::NumPlanarDirections + Dir] = TileIndex < TestNumEdgeTypes ? TileIndex : RandomStream.RandRange(0, TestNumEdgeTypes - 1);
+            }
+        }
+        Rules->BuildWeightTables();
+
+        if (bWithUnsupportedTile)
+        {
+            Edges[(TestNumTiles - 1) * FWFCCompiledRules::NumPlanarDirections] = TestNumEdgeTypes;
+        }
+
+        Rules->InitPropagator();
+        for (int32 Dir = 0; Dir < FWFCCompiledRules::NumPlanarDirections; Dir++)
+        {
+            const int32 OppositeDir = FWFCCompiledRules::GetOppositeDirection(Dir);
+            for (int32 TileIndex = 0; TileIndex < TestNumTiles; TileIndex++)
+            {
+                for (int32 NeighborTile = 0; NeighborTile < TestNumTiles; NeighborTile++)
+                {
+                    if (Edges[TileIndex * FWFCCompiledRules::NumPlanarDirections + Dir] == Edges[NeighborTile * FWFCCompiledRules::NumPlanarDirections + OppositeDir])
+                    {
+                        Rules->SetCompatible(TileIndex, NeighborTile, Dir);
+                    }
+                }
+            }
+        }
+        Rules->BuildInitialSupport();
+        return Rules;
+    }
+
+    FWFCSolverSettings MakeTestSettings(int32 Seed, EWFCPropagatorMode PropagatorMode, EWFCBacktrackMode BacktrackMode)
+    {
+        FWFCSolverSettings Settings;
+        Settings.Width = TestGridSize;
+        Settings.Height = TestGridSize;
+        Settings.Seed = Seed;
+        Settings.MaxIterations = TestGridSize * TestGridSize * 8;
+        Settings.MaxBacktrackSteps = 16;
+        Settings.PropagatorMode = PropagatorMode;
+        Settings.BacktrackMode = BacktrackMode;
+        return Settings;
+    }
+
+    struct FTestSolveResult
+    {
+        EWFCSolveState State = EWFCSolveState::Idle;
+        TArray<int32> Tiles;
+        FWFCSolverStats Stats;
+    };
+
+    FTestSolveResult RunTestSolver(FWFCSolver& Solver)
+    {
+        FTestSolveResult Result;
+        Result.State = Solver.Run();
+        Solver.GetTileGrid(Result.Tiles);
+        Result.Stats = Solver.GetStats();
+        return Result;
+    }
+
+    FTestSolveResult SolveTestGrid(const TSharedRef<FWFCCompiledRules>& Rules, int32 Seed, EWFCPropagatorMode PropagatorMode, EWFCBacktrackMode BacktrackMode)
+    {
+        FWFCSolver Solver(Rules, MakeTestSettings(Seed, PropagatorMode, BacktrackMode));
+        return RunTestSolver(Solver);
+    }
+
+    FString GetModeName(EWFCPropagatorMode PropagatorMode, EWFCBacktrackMode BacktrackMode, int32 RuleSeed, int32 Seed)
+    {
+        return FString::Printf(TEXT("%s/%s rules %d seed %d"), *UEnum::GetDisplayValueAsText(PropagatorMode).ToString(),
+                               *UEnum::GetDisplayValueAsText(BacktrackMode).ToString(), RuleSeed, Seed);
+    }
+
+    // 所有格子都已塌陷，且每对相邻格子在两个方向上都互相接受
+    bool IsValidTestGrid(const FWFCCompiledRules& Rules, const TArray<int32>& Tiles)
+    {
+        if (Tiles.Num() != TestGridSize * TestGridSize)
+        {
+            return false;
+        }
+
+        for (int32 X = 0; X < TestGridSize; X++)
+        {
+            for (int32 Y = 0; Y < TestGridSize; Y++)
+            {
+                const int32 TileIndex = Tiles[X * TestGridSize + Y];
+                if (!Rules.IsValidTileIndex(TileIndex))
+                {
+                    return false;
+                }
+
+                for (int32 Dir = 0; Dir < FWFCCompiledRules::NumPlanarDirections; Dir++)
+                {
+                    const int32 NeighborX = X + TestOffsets[Dir].X;
+                    const int32 NeighborY = Y + TestOffsets[Dir].Y;
+                    if (NeighborX < 0 || NeighborX >= TestGridSize || NeighborY < 0 || NeighborY >= TestGridSize)
+                    {
+                        continue;
+                    }
+
+                    const int32 NeighborTile = Tiles[NeighborX * TestGridSize + NeighborY];
+                    if (!Rules.IsValidTileIndex(NeighborTile) || !Rules.IsCompatible(TileIndex, NeighborTile, Dir)
+                        || !Rules.IsCompatible(NeighborTile, TileIndex, FWFCCompiledRules::GetOppositeDirection(Dir)))
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // 两次求解走过同一条搜索路径：结果、塌陷次数、回溯与重试次数都相同
+    void TestSameSolve(FAutomationTestBase& Test, const FString& What, const FTestSolveResult& A, const FTestSolveResult& B)
+    {
+        Test.TestEqual(*(What + TEXT(" state")), static_cast<int32>(A.State), static_cast<int32>(B.State));
+        Test.TestTrue(*(What + TEXT(" tiles")), A.Tiles == B.Tiles);
+        Test.TestEqual(*(What + TEXT(" collapses")), A.Stats.NumCollapses, B.Stats.NumCollapses);
+        Test.TestEqual(*(What + TEXT(" backtracks")), A.Stats.NumBacktracks, B.Stats.NumBacktracks);
+        Test.TestEqual(*(What + TEXT(" retries")), A.Stats.NumRetries, B.Stats.NumRetries);
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FWFCSolverValidityTest, "PCG_Game.MapGenerator.WFCSolver.Validity",
+    EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FWFCSolverValidityTest::RunTest(const FString& Parameters)
+{
+    for (int32 RuleSeed = 0; RuleSeed < NumRuleSeeds; RuleSeed++)
+    {
+        const TSharedRef<FWFCCompiledRules> Rules = MakeTestRules(RuleSeed);
+        for (const EWFCPropagatorMode PropagatorMode : PropagatorModes)
+        {
+            for (const EWFCBacktrackMode BacktrackMode : BacktrackModes)
+            {
+                int32 NumSucceeded = 0;
+                for (int32 Seed = 0; Seed < NumSolveSeeds; Seed++)
+                {
+                    const FString What = GetModeName(PropagatorMode, BacktrackMode, RuleSeed, Seed);
+                    const FTestSolveResult Result = SolveTestGrid(Rules, Seed, PropagatorMode, BacktrackMode);
+                    if (Result.State == EWFCSolveState::Succeeded)
+                    {
+                        NumSucceeded++;
+                        TestTrue(*(What + TEXT(" valid")), IsValidTestGrid(*Rules, Result.Tiles));
+                    }
+
+                    // 同一种子重复求解结果不变
+                    TestSameSolve(*this, What + TEXT(" repeat"), Result, SolveTestGrid(Rules, Seed, PropagatorMode, BacktrackMode));
+                }
+
+                // 规则可解，回溯与重试应能解出大部分种子
+                TestTrue(*(GetModeName(PropagatorMode, BacktrackMode, RuleSeed, NumSolveSeeds) + TEXT(" success rate")), NumSucceeded * 2 >= NumSolveSeeds);
+            }
+        }
+    }
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FWFCSolverPropagatorEquivalenceTest, "PCG_Game.MapGenerator.WFCSolver.PropagatorEquivalence",
+    EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FWFCSolverPropagatorEquivalenceTest::RunTest(const FString& Parameters)
+{
+    // AC-4 计数与重新扫描收敛到同一个弧相容状态，搜索路径应完全一致
+    // 含无支持 Tile 的规则检查两种模式的初始剔除也一致
+    for (const bool bWithUnsupportedTile : { false, true })
+    {
+        for (int32 RuleSeed = 0; RuleSeed < NumRuleSeeds; RuleSeed++)
+        {
+            const TSharedRef<FWFCCompiledRules> Rules = MakeTestRules(RuleSeed, bWithUnsupportedTile);
+            for (const EWFCBacktrackMode BacktrackMode : BacktrackModes)
+            {
+                for (int32 Seed = 0; Seed < NumSolveSeeds; Seed++)
+                {
+                    const FString What = GetModeName(EWFCPropagatorMode::SupportCount, BacktrackMode, RuleSeed, Seed)
+                        + (bWithUnsupportedTile ? TEXT(" unsupported tile") : TEXT(""));
+                    const FTestSolveResult RescanResult = SolveTestGrid(Rules, Seed, EWFCPropagatorMode::Rescan, BacktrackMode);
+                    TestSameSolve(*this, What, RescanResult, SolveTestGrid(Rules, Seed, EWFCPropagatorMode::SupportCount, BacktrackMode));
+
+                    if (!bWithUnsupportedTile || RescanResult.State != EWFCSolveState::Succeeded)
+                    {
+                        continue;
+                    }
+
+                    // 最上一行之外的格子在初始化时就已剔除该 Tile
+                    const int32 FirstCell = RescanResult.Tiles.Find(TestNumTiles - 1);
+                    TestTrue(*(What + TEXT(" placement")), FirstCell == INDEX_NONE || FirstCell >= (TestGridSize - 1) * TestGridSize);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FWFCSolverBacktrackEquivalenceTest, "PCG_Game.MapGenerator.WFCSolver.BacktrackEquivalence",
+    EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FWFCSolverBacktrackEquivalenceTest::RunTest(const FString& Parameters)
+{
+    // Trail 撤销与快照恢复回到同一状态（含 AC-4 计数），搜索路径应完全一致
+    int32 NumBacktracks = 0;
+    for (int32 RuleSeed = 0; RuleSeed < NumRuleSeeds; RuleSeed++)
+    {
+        const TSharedRef<FWFCCompiledRules> Rules = MakeTestRules(RuleSeed);
+        for (const EWFCPropagatorMode PropagatorMode : PropagatorModes)
+        {
+            for (int32 Seed = 0; Seed < NumSolveSeeds; Seed++)
+            {
+                const FTestSolveResult SnapshotResult = SolveTestGrid(Rules, Seed, PropagatorMode, EWFCBacktrackMode::Snapshot);
+                const FTestSolveResult TrailResult = SolveTestGrid(Rules, Seed, PropagatorMode, EWFCBacktrackMode::Trail);
+                TestSameSolve(*this, GetModeName(PropagatorMode, EWFCBacktrackMode::Trail, RuleSeed, Seed), SnapshotResult, TrailResult);
+                NumBacktracks += TrailResult.Stats.NumBacktracks;
+            }
+        }
+    }
+
+    // 否则撤销与恢复的路径没有被覆盖
+    TestTrue(TEXT("Backtracking exercised"), NumBacktracks > 0);
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FWFCSolverCellConstraintTest, "PCG_Game.MapGenerator.WFCSolver.CellConstraints",
+    EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FWFCSolverCellConstraintTest::RunTest(const FString& Parameters)
+{
+    const TSharedRef<FWFCCompiledRules> Rules = MakeTestRules(0);
+
+    // 前 NumEdgeTypes 个 Tile 四边同类型，可以放在任意位置
+    TBitArray<> FirstTwo(false, TestNumTiles);
+    FirstTwo[0] = true;
+    FirstTwo[1] = true;
+    TBitArray<> SecondAndThird(false, TestNumTiles);
+    SecondAndThird[1] = true;
+    SecondAndThird[2] = true;
+    TBitArray<> OnlyFirst(false, TestNumTiles);
+    OnlyFirst[0] = true;
+
+    for (const EWFCPropagatorMode PropagatorMode : PropagatorModes)
+    {
+        for (const EWFCBacktrackMode BacktrackMode : BacktrackModes)
+        {
+            int32 NumSucceeded = 0;
+            for (int32 Seed = 0; Seed < NumSolveSeeds; Seed++)
+            {
+                FWFCSolver Solver(Rules, MakeTestSettings(Seed, PropagatorMode, BacktrackMode));
+                // 同一格子多次设置取交集
+                Solver.SetCellConstraint(0, 0, FirstTwo);
+                Solver.SetCellConstraint(0, 0, SecondAndThird);
+                Solver.SetCellConstraint(TestGridSize / 2, TestGridSize / 2, OnlyFirst);
+
+                const FString What = GetModeName(PropagatorMode, BacktrackMode, 0, Seed);
+                const FTestSolveResult Result = RunTestSolver(Solver);
+                if (Result.State != EWFCSolveState::Succeeded)
+                {
+                    continue;
+                }
+
+                NumSucceeded++;
+                TestTrue(*(What + TEXT(" valid")), IsValidTestGrid(*Rules, Result.Tiles));
+                TestEqual(*(What + TEXT(" intersected constraint")), Solver.GetTileAt(0, 0), 1);
+                TestEqual(*(What + TEXT(" single constraint")), Solver.GetTileAt(TestGridSize / 2, TestGridSize / 2), 0);
+            }
+
+            TestTrue(*(GetModeName(PropagatorMode, BacktrackMode, 0, NumSolveSeeds) + TEXT(" success rate")), NumSucceeded * 2 >= NumSolveSeeds);
+        }
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,31 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "WFCTypes.generated.h"
+
+UENUM(BlueprintType)
+enum class EWFCPropagatorMode : uint8
+{
+    // 每次变化后重新扫描邻居的全部候选；初始化时与 AC-4 一样先剔除无支持的 Tile，两种模式结果一致
+    Rescan          UMETA(DisplayName = "Rescan"),
+    // AC-4：维护每格每 Tile 每方向的支持计数，按剔除增量传播
+    SupportCount    UMETA(DisplayName = "Support Count (AC-4)"),
+};
+
+UENUM(BlueprintType)
+enum class EWFCBacktrackMode : uint8
+{
+    // 每次塌陷前复制整个网格
+    Snapshot    UMETA(DisplayName = "Snapshot"),
+    // 只记录决策以来的剔除，回溯开销与被撤销的工作量相同
+    Trail       UMETA(DisplayName = "Trail"),
+};
+
+UENUM(BlueprintType)
+enum class EWFCSolveState : uint8
+{
+    Idle,
+    Running,
+    Succeeded,
+    Failed,
+};
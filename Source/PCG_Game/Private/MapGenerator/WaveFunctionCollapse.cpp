@@ -2,561 +2,1155 @@
 
 #include "WFCTileActor.h"
 #include "Components/StaticMeshComponent.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
 #include "Engine/Engine.h"
 #include "Engine/World.h"
+#include "Async/Async.h"
+#include "Tasks/Task.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Containers/LruCache.h"
+
+namespace
+{
+    // 与 FWFCCompiledRules 的方向一致：0 上(+X), 1 右(+Y), 2 下(-X), 3 左(-Y)
+    const FIntPoint DirectionOffsets[FWFCCompiledRules::NumPlanarDirections] = {
+        FIntPoint(1, 0), FIntPoint(0, 1), FIntPoint(-1, 0), FIntPoint(0, -1)
+    };
+
+    // Transform 是否使该对称类的 Tile 保持不变
+    bool IsSymmetryTransform(EWFCTileSymmetry Symmetry, int32 Transform)
+    {
+        switch (Symmetry)
+        {
+        case EWFCTileSymmetry::None:
+        case EWFCTileSymmetry::X:
+            return true;
+        case EWFCTileSymmetry::T:
+            return Transform == 0 || Transform == FWFCCompiledRules::MakeTransform(0, true);
+        case EWFCTileSymmetry::I:
+            return FWFCCompiledRules::GetTransformRotation(Transform) % 2 == 0;
+        case EWFCTileSymmetry::L:
+            return Transform == 0 || Transform == FWFCCompiledRules::MakeTransform(1, true);
+        case EWFCTileSymmetry::Backslash:
+            return Transform == 0 || Transform == FWFCCompiledRules::MakeTransform(2, false)
+                || Transform == FWFCCompiledRules::MakeTransform(1, true) || Transform == FWFCCompiledRules::MakeTransform(3, true);
+        default:
+            return Transform == 0;
+        }
+    }
+
+    // 进程内最近使用的规则，多个 Actor 使用同一 TileSet 时共享
+    constexpr int32 MaxLoadedRules = 8;
+
+    TLruCache<FSHAHash, TSharedPtr<FWFCCompiledRules>>& GetLoadedRuleCache()
+    {
+        static TLruCache<FSHAHash, TSharedPtr<FWFCCompiledRules>> LoadedRules(MaxLoadedRules);
+        return LoadedRules;
+    }
+
+    // 最近生成的地图，按 GetMapCacheKey 索引
+    constexpr int32 MaxCachedMaps = 16;
+
+    TLruCache<FString, TSharedPtr<const FWFCSavedMap>>& GetRecentMapCache()
+    {
+        static TLruCache<FString, TSharedPtr<const FWFCSavedMap>> RecentMaps(MaxCachedMaps);
+        return RecentMaps;
+    }
+
+    bool ReadMapFile(const FString& FilePath, FWFCSavedMap& OutMap)
+    {
+        TArray<uint8> Bytes;
+        if (!FFileHelper::LoadFileToArray(Bytes, *FilePath, FILEREAD_Silent))
+        {
+            return false;
+        }
+
+        FMemoryReader Reader(Bytes);
+        if (!OutMap.Serialize(Reader))
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Invalid WFC map file %s"), *FilePath);
+            return false;
+        }
+        return true;
+    }
+
+    bool WriteMapFile(const FString& FilePath, FWFCSavedMap& Map)
+    {
+        TArray<uint8> Bytes;
+        FMemoryWriter Writer(Bytes);
+        if (!Map.Serialize(Writer) || !FFileHelper::SaveArrayToFile(Bytes, *FilePath))
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Failed to write WFC map file %s"), *FilePath);
+            return false;
+        }
+        return true;
+    }
+
+    // 按修改时间只保留目录中最新的 MaxFiles 个 Extension 缓存文件，读取命中时会刷新修改时间
+    void PruneCacheDirectory(const FString& Directory, const TCHAR* Extension, int32 MaxFiles)
+    {
+        TArray<TPair<FDateTime, FString>> CacheFiles;
+        IFileManager::Get().IterateDirectoryStat(*Directory, [&CacheFiles, Extension](const TCHAR* FilePath, const FFileStatData& StatData)
+        {
+            if (!StatData.bIsDirectory && FPaths::GetExtension(FilePath) == Extension)
+            {
+                CacheFiles.Emplace(StatData.ModificationTime, FilePath);
+            }
+            return true;
+        });
+
+        if (CacheFiles.Num() <= MaxFiles)
+        {
+            return;
+        }
+
+        CacheFiles.Sort([](const TPair<FDateTime, FString>& A, const TPair<FDateTime, FString>& B) { return A.Key < B.Key; });
+        for (int32 Index = 0; Index < CacheFiles.Num() - MaxFiles; Index++)
+        {
+            IFileManager::Get().Delete(*CacheFiles[Index].Value, false, false, true);
+        }
+    }
+}
 
 AWaveFunctionCollapse::AWaveFunctionCollapse()
 {
-    PrimaryActorTick.bCanEverTick = false;
+    // 仅在分帧或后台求解期间开启 Tick
+    PrimaryActorTick.bCanEverTick = true;
+    PrimaryActorTick.bStartWithTickEnabled = false;
     RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("RootComponent"));
-    RandomStream.Initialize(RandomSeed);
 }
 
 void AWaveFunctionCollapse::BeginPlay()
 {
     Super::BeginPlay();
     
-    TileMap.Empty();
+    CompileTileSet();
+
+    if (bGenerateOnBeginPlay)
+    {
+        GenerateGrid();
+    }
+}
+
+void AWaveFunctionCollapse::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    // 后台任务持有求解器的共享引用，取消后自行结束
+    CancelGeneration();
+
+    Super::EndPlay(EndPlayReason);
+}
+
+void AWaveFunctionCollapse::CompileTileSet()
+{
+    if (TileSet.Num() == 0)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("No tiles defined in TileSet"));
+    }
+
+    const int32 NumDirections = GridDepth > 1 ? FWFCCompiledRules::MaxDirections : FWFCCompiledRules::NumPlanarDirections;
+    RulesHash = ComputeTileSetHash(NumDirections);
+    if (bUseRuleCache && LoadCachedRules(RulesHash))
+    {
+        return;
+    }
+
+    // 新建规则对象而非原地修改，仍在运行的求解器继续持有旧规则
+    const TSharedRef<FWFCCompiledRules> Rules = MakeShared<FWFCCompiledRules>();
+
+    // 重复 ID 以后出现的为准，顺序按首次出现
+    TArray<int32> UniqueSources;
+    TMap<FString, int32> UniqueByID;
+    for (int32 SourceIndex = 0; SourceIndex < TileSet.Num(); SourceIndex++)
+    {
+        const FWFCTile& Tile = TileSet[SourceIndex];
+        if (Tile.TileID.IsEmpty())
+        {
+            continue;
+        }
+
+        if (const int32* ExistingIndex = UniqueByID.Find(Tile.TileID))
+        {
+            UniqueSources[*ExistingIndex] = SourceIndex;
+            continue;
+        }
+
+        UniqueByID.Add(Tile.TileID, UniqueSources.Add(SourceIndex));
+    }
+
+    // 按对称类展开变体并分配稠密索引：同一陪集（相差一个对称变换）的变换共用一个变体
+    TArray<TStaticArray<int32, FWFCCompiledRules::NumTransforms>> VariantTiles;
+    TArray<int32> TileGroups;
+    for (int32 UniqueIndex = 0; UniqueIndex < UniqueSources.Num(); UniqueIndex++)
+    {
+        const int32 SourceIndex = UniqueSources[UniqueIndex];
+        const FWFCTile& Tile = TileSet[SourceIndex];
+        TStaticArray<int32, FWFCCompiledRules::NumTransforms>& Variants = VariantTiles.AddDefaulted_GetRef();
+        int32 NumVariants = 0;
+
+        for (int32 Transform = 0; Transform < FWFCCompiledRules::NumTransforms; Transform++)
+        {
+            Variants[Transform] = INDEX_NONE;
+            for (int32 PrevTransform = 0; PrevTransform < Transform; PrevTransform++)
+            {
+                const int32 VariantTransform = Rules->TileTransforms[Variants[PrevTransform]];
+                const int32 Relative = FWFCCompiledRules::ComposeTransforms(FWFCCompiledRules::InvertTransform(VariantTransform), Transform);
+                if (IsSymmetryTransform(Tile.Symmetry, Relative))
+                {
+                    Variants[Transform] = Variants[PrevTransform];
+                    break;
+                }
+            }
+
+            if (Variants[Transform] != INDEX_NONE)
+            {
+                continue;
+            }
+
+            const FString VariantID = NumVariants == 0 ? Tile.TileID : FString::Printf(TEXT("%s#%d"), *Tile.TileID, NumVariants);
+            Variants[Transform] = Rules->NumTiles;
+            Rules->TileIndexMap.Add(VariantID, Rules->NumTiles);
+            Rules->TileIDs.Add(VariantID);
+            Rules->SourceIndices.Add(SourceIndex);
+            Rules->TileTransforms.Add(static_cast<uint8>(Transform));
+            Rules->Weights.Add(Tile.Weight);
+            TileGroups.Add(UniqueIndex);
+            Rules->NumTiles++;
+            NumVariants++;
+        }
+    }
+
+    // 熵需要 log(w)，非正权重钳制为极小正数
+    for (int32 TileIndex = 0; TileIndex < Rules->NumTiles; TileIndex++)
+    {
+        if (Rules->Weights[TileIndex] <= 0.0f)
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Tile %s has non-positive weight, clamped"), *Rules->TileIDs[TileIndex]);
+            Rules->Weights[TileIndex] = KINDA_SMALL_NUMBER;
+        }
+    }
+    Rules->BuildWeightTables();
+
+    // 邻居字符串列表只在这里解析一次，生成 Tile x 方向的位集规则表
+    Rules->NumDirections = NumDirections;
+    Rules->InitPropagator();
+
+    for (int32 UniqueIndex = 0; UniqueIndex < UniqueSources.Num(); UniqueIndex++)
+    {
+        const FWFCTile& Tile = TileSet[UniqueSources[UniqueIndex]];
+        const TArray<FString>* NeighborArrays[FWFCCompiledRules::MaxDirections] = {
+            &Tile.UpNeighbors,
+            &Tile.RightNeighbors,
+            &Tile.DownNeighbors,
+            &Tile.LeftNeighbors,
+            &Tile.TopNeighbors,
+            &Tile.BottomNeighbors
+        };
+
+        // None 只使用手写规则，其余对称类把规则随整体变换复制到每个变体上
+        const int32 NumRuleTransforms = Tile.Symmetry == EWFCTileSymmetry::None ? 1 : FWFCCompiledRules::NumTransforms;
+
+        for (int32 Dir = 0; Dir < Rules->NumDirections; Dir++)
+        {
+            for (const FString& NeighborID : *NeighborArrays[Dir])
+            {
+                const int32 NeighborIndex = Rules->FindTileIndex(NeighborID);
+                if (NeighborIndex == INDEX_NONE)
+                {
+                    continue;
+                }
+
+                const int32 NeighborTransform = Rules->TileTransforms[NeighborIndex];
+                const TStaticArray<int32, FWFCCompiledRules::NumTransforms>& NeighborVariants = VariantTiles[TileGroups[NeighborIndex]];
+
+                for (int32 Transform = 0; Transform < NumRuleTransforms; Transform++)
+                {
+                    Rules->SetCompatible(VariantTiles[UniqueIndex][Transform],
+                                         NeighborVariants[FWFCCompiledRules::ComposeTransforms(Transform, NeighborTransform)],
+                                         FWFCCompiledRules::TransformDirection(Transform, Dir));
+                }
+            }
+        }
+    }
+
+    // 手写规则可能只在一侧声明，取两侧的交集
+    Rules->SymmetrizePropagator();
+    Rules->BuildInitialSupport();
+    CompiledRules = Rules;
+
+    ValidateTileConstraints();
+
+    if (bUseRuleCache)
+    {
+        SaveCachedRules(RulesHash);
+    }
+}
+
+FSHAHash AWaveFunctionCollapse::ComputeTileSetHash(int32 NumDirections) const
+{
+    FSHA1 HashState;
+    auto UpdateWithInt = [&HashState](int32 Value)
+    {
+        HashState.Update(reinterpret_cast<const uint8*>(&Value), sizeof(Value));
+    };
+    // 带上长度，避免相邻字符串拼接后产生相同的字节序列
+    auto UpdateWithString = [&HashState, &UpdateWithInt](const FString& Value)
+    {
+        UpdateWithInt(Value.Len());
+        HashState.UpdateWithString(*Value, Value.Len());
+    };
+
+    UpdateWithInt(FWFCCompiledRules::SerializationVersion);
+    UpdateWithInt(NumDirections);
+    UpdateWithInt(TileSet.Num());
     for (const FWFCTile& Tile : TileSet)
     {
-        if (!Tile.TileID.IsEmpty())
+        UpdateWithString(Tile.TileID);
+        for (const TArray<FString>* Neighbors : { &Tile.UpNeighbors, &Tile.RightNeighbors, &Tile.DownNeighbors,
+                                                  &Tile.LeftNeighbors, &Tile.TopNeighbors, &Tile.BottomNeighbors })
         {
-            TileMap.Add(Tile.TileID, Tile);
+            UpdateWithInt(Neighbors->Num());
+            for (const FString& NeighborID : *Neighbors)
+            {
+                UpdateWithString(NeighborID);
+            }
         }
+        HashState.Update(reinterpret_cast<const uint8*>(&Tile.Weight), sizeof(Tile.Weight));
+        UpdateWithInt(static_cast<int32>(Tile.Symmetry));
     }
+    HashState.Final();
 
-    GenerateGrid();
+    FSHAHash Hash;
+    HashState.GetHash(Hash.Hash);
+    return Hash;
+}
+
+FString AWaveFunctionCollapse::GetRuleCachePath(const FSHAHash& Hash)
+{
+    return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("WFCCache"), Hash.ToString() + TEXT(".bin"));
+}
+
+bool AWaveFunctionCollapse::LoadCachedRules(const FSHAHash& Hash)
+{
+    TLruCache<FSHAHash, TSharedPtr<FWFCCompiledRules>>& LoadedRules = GetLoadedRuleCache();
+    if (const TSharedPtr<FWFCCompiledRules>* Loaded = LoadedRules.FindAndTouch(Hash))
+    {
+        CompiledRules = *Loaded;
+        return true;
+    }
+
+    if (MaxCachedRuleFiles <= 0)
+    {
+        return false;
+    }
+
+    const FString RulePath = GetRuleCachePath(Hash);
+    TArray<uint8> Bytes;
+    if (!FFileHelper::LoadFileToArray(Bytes, *RulePath, FILEREAD_Silent))
+    {
+        return false;
+    }
+
+    const TSharedRef<FWFCCompiledRules> Rules = MakeShared<FWFCCompiledRules>();
+    FMemoryReader Reader(Bytes);
+    if (!Rules->Serialize(Reader))
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Ignoring invalid WFC rule cache %s"), *RulePath);
+        return false;
+    }
+
+    IFileManager::Get().SetTimeStamp(*RulePath, FDateTime::UtcNow());
+    LoadedRules.Add(Hash, Rules);
+    CompiledRules = Rules;
+    return true;
+}
+
+void AWaveFunctionCollapse::SaveCachedRules(const FSHAHash& Hash) const
+{
+    if (!CompiledRules.IsValid())
+    {
+        return;
+    }
+
+    GetLoadedRuleCache().Add(Hash, CompiledRules);
+
+    if (MaxCachedRuleFiles <= 0)
+    {
+        return;
+    }
+
+    TArray<uint8> Bytes;
+    FMemoryWriter Writer(Bytes);
+    CompiledRules->Serialize(Writer);
+
+    const FString RulePath = GetRuleCachePath(Hash);
+    if (!FFileHelper::SaveArrayToFile(Bytes, *RulePath))
+    {
+        UE_LOG(LogTemp, Warning, TEXT("Failed to write WFC rule cache %s"), *RulePath);
+        return;
+    }
+
+    PruneCacheDirectory(FPaths::GetPath(RulePath), TEXT("bin"), MaxCachedRuleFiles);
 }
 
 void AWaveFunctionCollapse::GenerateGrid()
 {
-    if (TileSet.Num() == 0)
+    // GridDepth 在平面与体素之间切换时方向数不同，需要重新编译
+    const int32 ExpectedDirections = GridDepth > 1 ? FWFCCompiledRules::MaxDirections : FWFCCompiledRules::NumPlanarDirections;
+    if (!CompiledRules.IsValid() || CompiledRules->NumTiles == 0 || CompiledRules->NumDirections != ExpectedDirections)
+    {
+        CompileTileSet();
+    }
+
+    if (!CompiledRules.IsValid() || CompiledRules->NumTiles == 0)
     {
-        UE_LOG(LogTemp, Warning, TEXT("No tiles defined in TileSet"));
         return;
     }
     
     ClearGrid();
-    RandomStream.Initialize(RandomSeed);
 
-    InitializeGrid();
+    // 同一规则、种子与设置的结果是确定的，命中缓存时只需读取并提交
+    PendingMapKey = bUseMapCache ? GetMapCacheKey() : FString();
+    if (!PendingMapKey.IsEmpty() && TryLoadCachedMap(PendingMapKey))
+    {
+        PendingMapKey.Reset();
+        return;
+    }
+
+    if (bSolveAsync)
+    {
+        LaunchAsyncSolve();
+        return;
+    }
+
+    ActiveSolver = MakeShared<FWFCSolver>(CompiledRules.ToSharedRef(), MakeSolverSettings());
+
+    TArray<TPair<FIntVector, TBitArray<>>> AnchorConstraints;
+    GetCellAnchorConstraints(AnchorConstraints);
+    for (const TPair<FIntVector, TBitArray<>>& Anchor : AnchorConstraints)
+    {
+        ActiveSolver->SetCellConstraint(Anchor.Key.X, Anchor.Key.Y, Anchor.Key.Z, Anchor.Value);
+    }
+
+    if (bTimeSliced)
+    {
+        ActiveSolver->Begin();
+        SetActorTickEnabled(true);
+        return;
+    }
     
-    if (SolveWFC())
+    SolveWFC();
+}
+
+FWFCSolverSettings AWaveFunctionCollapse::MakeSolverSettings() const
+{
+    FWFCSolverSettings Settings;
+    Settings.Width = GridWidth;
+    Settings.Height = GridHeight;
+    Settings.Depth = GridDepth;
+    Settings.Seed = RandomSeed;
+    Settings.MaxIterations = MaxIterations;
+    Settings.MaxRetries = MaxRetries;
+    Settings.bEnableBacktracking = bEnableBacktracking;
+    Settings.MaxBacktrackSteps = MaxBacktrackSteps;
+    Settings.PropagatorMode = PropagatorMode;
+    Settings.BacktrackMode = BacktrackMode;
+
+    if (!CompiledRules.IsValid())
     {
-        UE_LOG(LogTemp, Log, TEXT("WFC Generation completed successfully"));
+        return Settings;
     }
-    else
+
+    for (const FWFCTileCountLimit& Limit : TileCountLimits)
+    {
+        FWFCTileCountConstraint Constraint;
+        if (!GetTilesForID(Limit.TileID, Constraint.Tiles))
+        {
+            UE_LOG(LogTemp, Warning, TEXT("Tile count limit references non-existent tile %s"), *Limit.TileID);
+            continue;
+        }
+
+        Constraint.MinCount = Limit.MinCount;
+        Constraint.MaxCount = Limit.MaxCount < 0 ? MAX_int32 : Limit.MaxCount;
+        Settings.TileCountConstraints.Add(MoveTemp(Constraint));
+    }
+
+    if (WalkableTileIDs.Num() > 0)
+    {
+        Settings.WalkableTiles.Init(false, CompiledRules->NumTiles);
+        for (const FString& TileID : WalkableTileIDs)
+        {
+            TBitArray<> Tiles;
+            if (!GetTilesForID(TileID, Tiles))
+            {
+                UE_LOG(LogTemp, Warning, TEXT("Walkable tiles reference non-existent tile %s"), *TileID);
+                continue;
+            }
+            Settings.WalkableTiles.CombineWithBitwiseOR(Tiles, EBitwiseOperatorFlags::MaintainSize);
+        }
+    }
+
+    return Settings;
+}
+
+void AWaveFunctionCollapse::GetCellAnchorConstraints(TArray<TPair<FIntVector, TBitArray<>>>& OutConstraints) const
+{
+    OutConstraints.Reset(CellAnchors.Num());
+    if (!CompiledRules.IsValid())
+    {
+        return;
+    }
+
+    for (const FWFCCellAnchor& Anchor : CellAnchors)
+    {
+        if (!IsValidPosition(Anchor.Cell.X, Anchor.Cell.Y, Anchor.Cell.Z))
+        {
+            UE_LOG(LogTemp, Warning, TEXT("WFC anchor at (%d, %d, %d) is outside the grid"), Anchor.Cell.X, Anchor.Cell.Y, Anchor.Cell.Z);
+            continue;
+        }
+
+        TBitArray<> AllowedTiles(false, CompiledRules->NumTiles);
+        for (const FString& TileID : Anchor.AllowedTileIDs)
+        {
+            TBitArray<> Tiles;
+            if (!GetTilesForID(TileID, Tiles))
+            {
+                UE_LOG(LogTemp, Warning, TEXT("WFC anchor references non-existent tile %s"), *TileID);
+                continue;
+            }
+            AllowedTiles.CombineWithBitwiseOR(Tiles, EBitwiseOperatorFlags::MaintainSize);
+        }
+
+        if (AllowedTiles.Find(true) == INDEX_NONE)
+        {
+            continue;
+        }
+
+        OutConstraints.Emplace(Anchor.Cell, MoveTemp(AllowedTiles));
+    }
+}
+
+void AWaveFunctionCollapse::SetCellTile(int32 X, int32 Y, int32 Z, const FString& TileID)
+{
+    SetCellAllowedTiles(X, Y, Z, { TileID });
+}
+
+void AWaveFunctionCollapse::SetCellAllowedTiles(int32 X, int32 Y, int32 Z, const TArray<FString>& TileIDs)
+{
+    const FIntVector Cell(X, Y, Z);
+    FWFCCellAnchor* Anchor = CellAnchors.FindByPredicate([&Cell](const FWFCCellAnchor& Existing)
+    {
+        return Existing.Cell == Cell;
+    });
+
+    if (!Anchor)
+    {
+        Anchor = &CellAnchors.AddDefaulted_GetRef();
+        Anchor->Cell = Cell;
+    }
+    Anchor->AllowedTileIDs = TileIDs;
+}
+
+void AWaveFunctionCollapse::ClearCellConstraints()
+{
+    CellAnchors.Empty();
+}
+
+bool AWaveFunctionCollapse::GetTilesForID(const FString& TileID, TBitArray<>& OutTiles) const
+{
+    OutTiles.Init(false, CompiledRules.IsValid() ? CompiledRules->NumTiles : 0);
+    bool bFound = false;
+    for (int32 TileIndex = 0; TileIndex < OutTiles.Num(); TileIndex++)
+    {
+        const int32 SourceIndex = CompiledRules->SourceIndices[TileIndex];
+        if (CompiledRules->TileIDs[TileIndex] == TileID || (TileSet.IsValidIndex(SourceIndex) && TileSet[SourceIndex].TileID == TileID))
+        {
+            OutTiles[TileIndex] = true;
+            bFound = true;
+        }
+    }
+    return bFound;
+}
+
+void AWaveFunctionCollapse::Tick(float DeltaTime)
+{
+    Super::Tick(DeltaTime);
+
+    // 后台求解只在这里汇报进度，完成由游戏线程任务处理
+    if (ActiveAsyncSolve.IsValid())
+    {
+        OnGenerationProgress.Broadcast(GetGenerationProgress());
+        return;
+    }
+
+    if (!ActiveSolver.IsValid())
+    {
+        SetActorTickEnabled(false);
+        return;
+    }
+
+    const double StartTime = FPlatformTime::Seconds();
+    int32 StepsThisTick = 0;
+
+    while (ActiveSolver->Step() == EWFCSolveState::Running)
+    {
+        StepsThisTick++;
+        if (MaxCollapsesPerTick > 0 && StepsThisTick >= MaxCollapsesPerTick)
+        {
+            break;
+        }
+        if (TickBudgetMicroseconds > 0.0f && (FPlatformTime::Seconds() - StartTime) * 1e6 >= TickBudgetMicroseconds)
+        {
+            break;
+        }
+    }
+
+    OnGenerationProgress.Broadcast(GetGenerationProgress());
+
+    if (ActiveSolver->GetState() != EWFCSolveState::Running)
     {
-        UE_LOG(LogTemp, Warning, TEXT("WFC Generation failed"));
+        FinishSolve(ActiveSolver);
     }
 }
 
 void AWaveFunctionCollapse::ClearGrid()
 {
+    CancelGeneration();
     ClearGeneratedMeshes();
-    Grid.Empty();
+    SolvedTiles.Empty();
+}
+
+void AWaveFunctionCollapse::CancelGeneration()
+{
+    if (ActiveAsyncSolve.IsValid())
+    {
+        ActiveAsyncSolve->Cancel();
+        ActiveAsyncSolve.Reset();
+    }
+
+    ActiveSolver.Reset();
+    SetActorTickEnabled(false);
+}
+
+float AWaveFunctionCollapse::GetGenerationProgress() const
+{
+    if (ActiveAsyncSolve.IsValid())
+    {
+        return ActiveAsyncSolve->GetProgress();
+    }
+
+    if (ActiveSolver.IsValid())
+    {
+        return ActiveSolver->GetProgress();
+    }
+
+    return SolvedTiles.Num() > 0 ? 1.0f : 0.0f;
 }
 
 void AWaveFunctionCollapse::SetSeed(int32 NewSeed)
 {
     RandomSeed = NewSeed;
-    RandomStream.Initialize(RandomSeed);
 }
 
-void AWaveFunctionCollapse::InitializeGrid()
+FString AWaveFunctionCollapse::GetTileIDAt(int32 X, int32 Y, int32 Z) const
+{
+    const int32 TileIndex = GetTileIndexAt(X, Y, Z);
+    return TileIndex != INDEX_NONE ? CompiledRules->TileIDs[TileIndex] : FString();
+}
+
+int32 AWaveFunctionCollapse::GetTileIndexAt(int32 X, int32 Y, int32 Z) const
+{
+    if (!IsValidPosition(X, Y, Z) || !SolvedTiles.IsValidIndex(GetCellIndex(X, Y, Z)))
+    {
+        return INDEX_NONE;
+    }
+
+    const int32 TileIndex = SolvedTiles[GetCellIndex(X, Y, Z)];
+    return CompiledRules.IsValid() && CompiledRules->IsValidTileIndex(TileIndex) ? TileIndex : INDEX_NONE;
+}
+
+bool AWaveFunctionCollapse::SolveWFC()
+{
+    ActiveSolver->Run();
+    
+    const bool bSuccess = ActiveSolver->GetState() == EWFCSolveState::Succeeded;
+    FinishSolve(ActiveSolver);
+    return bSuccess;
+}
+
+void AWaveFunctionCollapse::LaunchAsyncSolve()
+{
+    const int32 NumSolvers = bSpeculativeSolve ? FMath::Max(SpeculativeSolveCount, 1) : 1;
+    ActiveAsyncSolve = MakeShared<FWFCSpeculativeSolve>(CompiledRules.ToSharedRef(), MakeSolverSettings(), NumSolvers);
+    SetActorTickEnabled(true);
+
+    TArray<TPair<FIntVector, TBitArray<>>> AnchorConstraints;
+    GetCellAnchorConstraints(AnchorConstraints);
+    for (const TPair<FIntVector, TBitArray<>>& Anchor : AnchorConstraints)
+    {
+        ActiveAsyncSolve->SetCellConstraint(Anchor.Key.X, Anchor.Key.Y, Anchor.Key.Z, Anchor.Value);
+    }
+
+    // 求解器只依赖规则与设置，整个求解在后台任务中运行，结果回到游戏线程再生成
+    TSharedPtr<FWFCSpeculativeSolve> AsyncSolve = ActiveAsyncSolve;
+    TWeakObjectPtr<AWaveFunctionCollapse> WeakThis(this);
+    for (int32 SolverIndex = 0; SolverIndex < NumSolvers; SolverIndex++)
+    {
+        UE::Tasks::Launch(UE_SOURCE_LOCATION, [AsyncSolve, SolverIndex, WeakThis]()
+        {
+            if (!AsyncSolve->RunSolver(SolverIndex))
+            {
+                return;
+            }
+
+            AsyncTask(ENamedThreads::GameThread, [AsyncSolve, WeakThis]()
+            {
+                // 期间被取消或重新生成时丢弃结果
+                AWaveFunctionCollapse* This = WeakThis.Get();
+                if (This && This->ActiveAsyncSolve == AsyncSolve)
+                {
+                    This->ActiveAsyncSolve.Reset();
+                    if (AsyncSolve->Num() > 1 && AsyncSolve->GetWinner().IsValid())
+                    {
+                        UE_LOG(LogTemp, Log, TEXT("WFC speculative solve %d of %d won"), AsyncSolve->GetWinnerIndex(), AsyncSolve->Num());
+                    }
+                    This->FinishSolve(AsyncSolve->GetWinner());
+                }
+            });
+        });
+    }
+}
+
+void AWaveFunctionCollapse::FinishSolve(const TSharedPtr<FWFCSolver>& Solver)
+{
+    // 先取得引用再清理状态，Solver 可能就是 ActiveSolver
+    const TSharedPtr<FWFCSolver> FinishedSolver = Solver;
+    ActiveSolver.Reset();
+    SetActorTickEnabled(false);
+
+    const bool bSuccess = FinishedSolver.IsValid() && FinishedSolver->GetState() == EWFCSolveState::Succeeded;
+    if (bSuccess)
+    {
+        LastSolvedSeed = FinishedSolver->GetSolvedSeed();
+        FinishedSolver->GetTileGrid(SolvedTiles);
+        CommitSolvedGrid();
+
+        if (!PendingMapKey.IsEmpty())
+        {
+            CacheSolvedMap(PendingMapKey);
+        }
+        UE_LOG(LogTemp, Log, TEXT("WFC Generation completed successfully (seed %d, retry %d)"), LastSolvedSeed, FinishedSolver->GetRetryCount() + 1);
+    }
+    else
+    {
+        UE_LOG(LogTemp, Warning, TEXT("WFC Generation failed after %d retries"), MaxRetries);
+    }
+
+    PendingMapKey.Reset();
+    OnGenerationCompleted.Broadcast(bSuccess);
+}
+
+FString AWaveFunctionCollapse::GetMapCacheKey() const
+{
+    // 除种子与尺寸外，回溯与重试等设置也会改变同一种子的结果
+    const FWFCSolverSettings Settings = MakeSolverSettings();
+    uint32 SettingsHash = GetTypeHash(Settings.MaxIterations);
+    SettingsHash = HashCombine(SettingsHash, GetTypeHash(Settings.MaxRetries));
+    SettingsHash = HashCombine(SettingsHash, GetTypeHash(Settings.bEnableBacktracking));
+    SettingsHash = HashCombine(SettingsHash, GetTypeHash(Settings.MaxBacktrackSteps));
+    SettingsHash = HashCombine(SettingsHash, GetTypeHash(Settings.PropagatorMode));
+    SettingsHash = HashCombine(SettingsHash, GetTypeHash(Settings.BacktrackMode));
+    SettingsHash = HashCombine(SettingsHash, GetTypeHash(bSolveAsync && bSpeculativeSolve ? SpeculativeSolveCount : 0));
+    for (const FWFCTileCountLimit& Limit : TileCountLimits)
+    {
+        SettingsHash = HashCombine(SettingsHash, GetTypeHash(Limit.TileID));
+        SettingsHash = HashCombine(SettingsHash, GetTypeHash(Limit.MinCount));
+        SettingsHash = HashCombine(SettingsHash, GetTypeHash(Limit.MaxCount));
+    }
+    for (const FString& TileID : WalkableTileIDs)
+    {
+        SettingsHash = HashCombine(SettingsHash, GetTypeHash(TileID));
+    }
+    for (const FWFCCellAnchor& Anchor : CellAnchors)
+    {
+        SettingsHash = HashCombine(SettingsHash, GetTypeHash(Anchor.Cell));
+        for (const FString& TileID : Anchor.AllowedTileIDs)
+        {
+            SettingsHash = HashCombine(SettingsHash, GetTypeHash(TileID));
+        }
+    }
+
+    return FString::Printf(TEXT("%s_%d_%dx%dx%d_%08x"), *RulesHash.ToString(), RandomSeed, GridWidth, GridHeight, GridDepth, SettingsHash);
+}
+
+FString AWaveFunctionCollapse::GetMapCachePath(const FString& MapKey)
+{
+    return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("WFCMaps"), MapKey + TEXT(".wfcmap"));
+}
+
+bool AWaveFunctionCollapse::TryLoadCachedMap(const FString& MapKey)
+{
+    TLruCache<FString, TSharedPtr<const FWFCSavedMap>>& RecentMaps = GetRecentMapCache();
+    if (const TSharedPtr<const FWFCSavedMap>* Recent = RecentMaps.FindAndTouch(MapKey))
+    {
+        return ApplySavedMap(**Recent);
+    }
+
+    if (MaxCachedMapFiles <= 0)
+    {
+        return false;
+    }
+
+    const FString MapPath = GetMapCachePath(MapKey);
+    const TSharedRef<FWFCSavedMap> Map = MakeShared<FWFCSavedMap>();
+    if (!ReadMapFile(MapPath, *Map) || !ApplySavedMap(*Map))
+    {
+        return false;
+    }
+
+    IFileManager::Get().SetTimeStamp(*MapPath, FDateTime::UtcNow());
+    RecentMaps.Add(MapKey, Map);
+    return true;
+}
+
+void AWaveFunctionCollapse::CacheSolvedMap(const FString& MapKey)
 {
-    Grid.SetNum(GridWidth);
-    for (int32 X = 0; X < GridWidth; X++)
+    const TSharedRef<FWFCSavedMap> Map = MakeShared<FWFCSavedMap>();
+    Map->Seed = LastSolvedSeed;
+    Map->RulesHash = RulesHash;
+    Map->Width = GridWidth;
+    Map->Height = GridHeight;
+    Map->Depth = GridDepth;
+    Map->Tiles = SolvedTiles;
+
+    GetRecentMapCache().Add(MapKey, Map);
+
+    const FString MapPath = GetMapCachePath(MapKey);
+    if (MaxCachedMapFiles > 0 && WriteMapFile(MapPath, *Map))
     {
-        Grid[X].SetNum(GridHeight);
-        for (int32 Y = 0; Y < GridHeight; Y++)
-        {
-            FWFCCell& Cell = Grid[X][Y];
-            Cell.bCollapsed = false;
-            Cell.SelectedTile = "";
-            Cell.PossibleTiles.Empty();
-            
-            for (const FWFCTile& Tile : TileSet)
-            {
-                if (!Tile.TileID.IsEmpty())
-                {
-                    Cell.PossibleTiles.Add(Tile.TileID);
-                }
-            }
-            
-            Cell.Entropy = Cell.PossibleTiles.Num();
-        }
+        PruneCacheDirectory(FPaths::GetPath(MapPath), TEXT("wfcmap"), MaxCachedMapFiles);
     }
 }
 
-bool AWaveFunctionCollapse::SolveWFC()
+bool AWaveFunctionCollapse::ApplySavedMap(const FWFCSavedMap& Map)
 {
-    if (bEnableBacktracking)
+    if (!CompiledRules.IsValid() || Map.RulesHash != RulesHash)
     {
-        return SolveWFCWithBacktracking();
+        UE_LOG(LogTemp, Warning, TEXT("WFC map was generated from a different TileSet"));
+        return false;
     }
 
-    for (CurrentRetry = 0; CurrentRetry < MaxRetries; CurrentRetry++)
+    for (const int32 TileIndex : Map.Tiles)
     {
-        InitializeGrid();
-        
-        int32 Iterations = 0;
-        bool bSuccess = true;
-        
-        while (Iterations < MaxIterations && bSuccess)
-        {
-            Iterations++;
-
-            FIntPoint LowestEntropyPos = FindLowestEntropyCell();
-            
-            if (LowestEntropyPos.X == -1)
-            {
-                UE_LOG(LogTemp, Log, TEXT("WFC completed successfully on retry %d"), CurrentRetry + 1);
-                return true;
-            }
-            
-            if (Grid[LowestEntropyPos.X][LowestEntropyPos.Y].Entropy == 0)
-            {
-                UE_LOG(LogTemp, Warning, TEXT("Contradiction found at (%d, %d), retry %d"), 
-                       LowestEntropyPos.X, LowestEntropyPos.Y, CurrentRetry + 1);
-                bSuccess = false;
-                break;
-            }
-            
-            CollapseCell(LowestEntropyPos.X, LowestEntropyPos.Y);
-            PropagateConstraints(LowestEntropyPos.X, LowestEntropyPos.Y);
-        }
-        
-        if (!bSuccess)
+        if (!CompiledRules->IsValidTileIndex(TileIndex))
         {
-            RandomSeed += 1000;
-            RandomStream.Initialize(RandomSeed);
-            ClearGrid();
+            UE_LOG(LogTemp, Warning, TEXT("WFC map references invalid tile index %d"), TileIndex);
+            return false;
         }
     }
-    
-    UE_LOG(LogTemp, Error, TEXT("WFC failed after %d retries"), MaxRetries);
-    return false;
-}
 
-bool AWaveFunctionCollapse::SolveWFCWithBacktracking()
-{
-    for (CurrentRetry = 0; CurrentRetry < MaxRetries; CurrentRetry++)
-    {
-        InitializeGrid();
-        ClearSnapshots();
-        
-        int32 Iterations = 0;
-        
-        while (Iterations < MaxIterations)
-        {
-            Iterations++;
+    ClearGrid();
+    GridWidth = Map.Width;
+    GridHeight = Map.Height;
+    GridDepth = Map.Depth;
+    LastSolvedSeed = Map.Seed;
+    SolvedTiles = Map.Tiles;
+    CommitSolvedGrid();
 
-            FIntPoint LowestEntropyPos = FindLowestEntropyCell();
-            
-            if (LowestEntropyPos.X == -1)
-            {
-                UE_LOG(LogTemp, Log, TEXT("WFC completed successfully with backtracking"));
-                return true;
-            }
-            
-            if (Grid[LowestEntropyPos.X][LowestEntropyPos.Y].Entropy == 0)
-            {
-                UE_LOG(LogTemp, Warning, TEXT("Contradiction at (%d, %d), attempting backtrack"), 
-                       LowestEntropyPos.X, LowestEntropyPos.Y);
-                
-                if (RestoreSnapshot())
-                {
-                    UE_LOG(LogTemp, Log, TEXT("Backtracked successfully"));
-                    continue;
-                }
-                else
-                {
-                    UE_LOG(LogTemp, Warning, TEXT("Cannot backtrack further, restarting"));
-                    break;
-                }
-            }
-            
-            // 回溯用
-            SaveSnapshot(LowestEntropyPos);
-            
-            CollapseCell(LowestEntropyPos.X, LowestEntropyPos.Y);
-            PropagateConstraints(LowestEntropyPos.X, LowestEntropyPos.Y);
-            
-            if (HasContradiction())
-            {
-                UE_LOG(LogTemp, Warning, TEXT("Contradiction detected after propagation"));
-            }
-        }
-        
-        // 如果到达这里，说明需要重试
-        RandomSeed += 1000;
-        RandomStream.Initialize(RandomSeed);
-        ClearGrid();
-    }
-    
-    return false;
+    UE_LOG(LogTemp, Log, TEXT("WFC map loaded (seed %d, %dx%dx%d)"), LastSolvedSeed, GridWidth, GridHeight, GridDepth);
+    OnGenerationCompleted.Broadcast(true);
+    return true;
 }
 
-void AWaveFunctionCollapse::SaveSnapshot(const FIntPoint& LastCollapsedCell)
+bool AWaveFunctionCollapse::SaveMapToFile(const FString& FilePath) const
 {
-    // 限制快照数量
-    if (Snapshots.Num() >= MaxBacktrackSteps)
+    if (SolvedTiles.Num() != GetNumCells())
     {
-        Snapshots.RemoveAt(0);
+        UE_LOG(LogTemp, Warning, TEXT("No generated WFC map to save"));
+        return false;
     }
-    
-    FWFCSnapshot Snapshot;
-    Snapshot.GridState = Grid;
-    Snapshot.LastCollapsedCell = LastCollapsedCell;
-    Snapshots.Add(Snapshot);
+
+    FWFCSavedMap Map;
+    Map.Seed = LastSolvedSeed;
+    Map.RulesHash = RulesHash;
+    Map.Width = GridWidth;
+    Map.Height = GridHeight;
+    Map.Depth = GridDepth;
+    Map.Tiles = SolvedTiles;
+    return WriteMapFile(FilePath, Map);
 }
 
-bool AWaveFunctionCollapse::RestoreSnapshot()
+bool AWaveFunctionCollapse::LoadMapFromFile(const FString& FilePath)
 {
-    if (Snapshots.Num() == 0)
+    FWFCSavedMap Map;
+    if (!ReadMapFile(FilePath, Map))
     {
+        UE_LOG(LogTemp, Warning, TEXT("Failed to read WFC map file %s"), *FilePath);
         return false;
     }
-    
-    FWFCSnapshot LastSnapshot = Snapshots.Last();
-    Snapshots.RemoveAt(Snapshots.Num() - 1);
-    
-    Grid = LastSnapshot.GridState;
-    
-    FIntPoint ProblemCell = LastSnapshot.LastCollapsedCell;
-    if (IsValidPosition(ProblemCell.X, ProblemCell.Y))
+
+    // 存档可能是体素网格，方向数不同时需要先按存档尺寸编译规则
+    const int32 ExpectedDirections = Map.Depth > 1 ? FWFCCompiledRules::MaxDirections : FWFCCompiledRules::NumPlanarDirections;
+    if (!CompiledRules.IsValid() || CompiledRules->NumDirections != ExpectedDirections)
     {
-        FWFCCell& Cell = Grid[ProblemCell.X][ProblemCell.Y];
-        
-        if (Cell.bCollapsed && !Cell.SelectedTile.IsEmpty())
-        {
-            Cell.PossibleTiles.Remove(Cell.SelectedTile);
-            Cell.bCollapsed = false;
-            Cell.SelectedTile = "";
-            Cell.Entropy = Cell.PossibleTiles.Num();
-            
-            UE_LOG(LogTemp, Log, TEXT("Removed problematic tile from cell (%d, %d), new entropy: %d"), 
-                   ProblemCell.X, ProblemCell.Y, Cell.Entropy);
-        }
+        GridDepth = Map.Depth;
+        CompileTileSet();
     }
-    
-    return true;
-}
 
-void AWaveFunctionCollapse::ClearSnapshots()
-{
-    Snapshots.Empty();
+    return ApplySavedMap(Map);
 }
 
-bool AWaveFunctionCollapse::HasContradiction() const
+void AWaveFunctionCollapse::CommitSolvedGrid()
 {
+    if (OutputMode == EWFCOutputMode::InstancedMeshes)
+    {
+        CommitInstancedMeshes();
+        return;
+    }
+
+    // 只生成最终结果，回溯或重试中被撤销的塌陷不会留下 Actor
+    GeneratedTiles.Init(nullptr, GetNumCells());
     for (int32 X = 0; X < GridWidth; X++)
     {
         for (int32 Y = 0; Y < GridHeight; Y++)
         {
-            const FWFCCell& Cell = Grid[X][Y];
-            if (!Cell.bCollapsed && Cell.Entropy == 0)
+            for (int32 Z = 0; Z < GridDepth; Z++)
             {
-                return true;
+                GeneratedTiles[GetCellIndex(X, Y, Z)] = SpawnTileAtPosition(X, Y, Z, SolvedTiles[GetCellIndex(X, Y, Z)]);
             }
         }
     }
-    return false;
 }
 
-void AWaveFunctionCollapse::HandleContradiction()
+bool AWaveFunctionCollapse::ResolveRegion(int32 RegionX, int32 RegionY, int32 RegionWidth, int32 RegionHeight, int32 Seed)
 {
-    for (int32 X = 0; X < GridWidth; X++)
+    if (IsGenerating() || !CompiledRules.IsValid() || SolvedTiles.Num() != GetNumCells())
     {
-        for (int32 Y = 0; Y < GridHeight; Y++)
+        UE_LOG(LogTemp, Warning, TEXT("ResolveRegion requires a completed grid"));
+        return false;
+    }
+
+    const int32 MinX = FMath::Max(RegionX, 0);
+    const int32 MinY = FMath::Max(RegionY, 0);
+    const int32 MaxX = FMath::Min(RegionX + RegionWidth, GridWidth);
+    const int32 MaxY = FMath::Min(RegionY + RegionHeight, GridHeight);
+    if (MinX >= MaxX || MinY >= MaxY)
+    {
+        return false;
+    }
+
+    FWFCSolverSettings Settings = MakeSolverSettings();
+    Settings.Width = MaxX - MinX;
+    Settings.Height = MaxY - MinY;
+    Settings.Seed = Seed;
+    // 全局约束针对整张地图，区域内的子问题无法单独判断
+    Settings.TileCountConstraints.Empty();
+    Settings.WalkableTiles.Empty();
+    FWFCSolver Solver(CompiledRules.ToSharedRef(), Settings);
+
+    // 区域外的格子保持不变，作为边缘格子的约束；体素网格时区域包含所有层
+    // 编译时已取两侧规则的交集，GetAllowedTiles 同时满足外侧 Tile 对本格的要求
+    for (int32 X = MinX; X < MaxX; X++)
+    {
+        for (int32 Y = MinY; Y < MaxY; Y++)
         {
-            FWFCCell& Cell = Grid[X][Y];
-            if (!Cell.bCollapsed && Cell.Entropy == 0)
+            for (int32 Dir = 0; Dir < FWFCCompiledRules::NumPlanarDirections; Dir++)
             {
-                if (bAllowFallbackTiles)
+                const FIntPoint NeighborPos(X + DirectionOffsets[Dir].X, Y + DirectionOffsets[Dir].Y);
+                const bool bInsideRegion = NeighborPos.X >= MinX && NeighborPos.X < MaxX && NeighborPos.Y >= MinY && NeighborPos.Y < MaxY;
+                if (bInsideRegion || !IsValidPosition(NeighborPos.X, NeighborPos.Y))
+                {
+                    continue;
+                }
+
+                for (int32 Z = 0; Z < GridDepth; Z++)
                 {
-                    // Fallback最多使用 ，再Fallback第一个
-                    FString FallbackTile = GetFallbackTile(X, Y);
-                    if (!FallbackTile.IsEmpty())
+                    const int32 NeighborTile = SolvedTiles[GetCellIndex(NeighborPos.X, NeighborPos.Y, Z)];
+                    if (CompiledRules->IsValidTileIndex(NeighborTile))
                     {
-                        Cell.PossibleTiles.Add(FallbackTile);
-                        Cell.Entropy = 1;
-                        UE_LOG(LogTemp, Warning, TEXT("Applied fallback tile %s to cell (%d, %d)"), 
-                               *FallbackTile, X, Y);
+                        Solver.SetCellConstraint(X - MinX, Y - MinY, Z, CompiledRules->GetAllowedTiles(Dir, NeighborTile));
                     }
                 }
             }
         }
     }
-}
 
-FString AWaveFunctionCollapse::GetFallbackTile(int32 X, int32 Y)
-{
-    TMap<FString, int32> TileFrequency;
-    
-    for (const FWFCTile& Tile : TileSet)
+    // 区域内的预设格子同样生效
+    TArray<TPair<FIntVector, TBitArray<>>> AnchorConstraints;
+    GetCellAnchorConstraints(AnchorConstraints);
+    for (const TPair<FIntVector, TBitArray<>>& Anchor : AnchorConstraints)
     {
-        if (!Tile.TileID.IsEmpty())
+        if (Anchor.Key.X >= MinX && Anchor.Key.X < MaxX && Anchor.Key.Y >= MinY && Anchor.Key.Y < MaxY)
         {
-            TileFrequency.Add(Tile.TileID, 0);
+            Solver.SetCellConstraint(Anchor.Key.X - MinX, Anchor.Key.Y - MinY, Anchor.Key.Z, Anchor.Value);
         }
     }
-    
-    TArray<FIntPoint> Neighbors = {
-        FIntPoint(X +1 , Y ), FIntPoint(X , Y + 1),
-        FIntPoint(X -1, Y ), FIntPoint(X , Y -1)
-    };
-    
-    for (const FIntPoint& NeighborPos : Neighbors)
+
+    if (Solver.Run() != EWFCSolveState::Succeeded)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("WFC region (%d, %d) %dx%d could not be re-solved, map unchanged"), MinX, MinY, Settings.Width, Settings.Height);
+        return false;
+    }
+
+    // 只替换结果发生变化的格子
+    int32 NumChangedCells = 0;
+    for (int32 X = MinX; X < MaxX; X++)
     {
-        if (IsValidPosition(NeighborPos.X, NeighborPos.Y))
+        for (int32 Y = MinY; Y < MaxY; Y++)
         {
-            const FWFCCell& NeighborCell = Grid[NeighborPos.X][NeighborPos.Y];
-            if (NeighborCell.bCollapsed && !NeighborCell.SelectedTile.IsEmpty())
+            for (int32 Z = 0; Z < GridDepth; Z++)
             {
-                if (TileFrequency.Contains(NeighborCell.SelectedTile))
+                const int32 NewTile = Solver.GetTileAt(X - MinX, Y - MinY, Z);
+                int32& CurrentTile = SolvedTiles[GetCellIndex(X, Y, Z)];
+                if (NewTile != CurrentTile)
                 {
-                    TileFrequency[NeighborCell.SelectedTile]++;
+                    UpdateCellOutput(X, Y, Z, CurrentTile, NewTile);
+                    CurrentTile = NewTile;
+                    NumChangedCells++;
                 }
             }
         }
     }
-    
-    FString BestTile = "";
-    int32 MaxFrequency = -1;
-    
-    for (const auto& Pair : TileFrequency)
+
+    for (TPair<UStaticMesh*, UHierarchicalInstancedStaticMeshComponent*>& Pair : TileMeshComponents)
     {
-        if (Pair.Value > MaxFrequency)
+        if (IsValid(Pair.Value))
         {
-            MaxFrequency = Pair.Value;
-            BestTile = Pair.Key;
+            Pair.Value->MarkRenderStateDirty();
         }
     }
-    
-    if (BestTile.IsEmpty() && TileSet.Num() > 0)
-    {
-        BestTile = TileSet[0].TileID;
-    }
-    
-    return BestTile;
+
+    UE_LOG(LogTemp, Log, TEXT("WFC region (%d, %d) %dx%d re-solved, %d cells changed"), MinX, MinY, Settings.Width, Settings.Height, NumChangedCells);
+    return true;
 }
 
-// 检查所有所有规则可用
-void AWaveFunctionCollapse::ValidateTileConstraints()
+void AWaveFunctionCollapse::UpdateCellOutput(int32 X, int32 Y, int32 Z, int32 OldTileIndex, int32 NewTileIndex)
 {
-    for (const FWFCTile& Tile : TileSet)
-    {
-        if (Tile.TileID.IsEmpty()) continue;
+    const int32 CellIndex = GetCellIndex(X, Y, Z);
 
-        TArray<TArray<FString>*> NeighborArrays = {
-            const_cast<TArray<FString>*>(&Tile.UpNeighbors),
-            const_cast<TArray<FString>*>(&Tile.RightNeighbors),
-            const_cast<TArray<FString>*>(&Tile.DownNeighbors),
-            const_cast<TArray<FString>*>(&Tile.LeftNeighbors)
-        };
-        
-        for (int32 Dir = 0; Dir < 4; Dir++)
+    if (OutputMode == EWFCOutputMode::Actors)
+    {
+        if (GeneratedTiles.IsValidIndex(CellIndex))
         {
-            for (const FString& NeighborID : *NeighborArrays[Dir])
+            if (IsValid(GeneratedTiles[CellIndex]))
             {
-                if (!TileMap.Contains(NeighborID))
-                {
-                    UE_LOG(LogTemp, Warning, TEXT("Tile %s references non-existent neighbor %s in direction %d"), 
-                           *Tile.TileID, *NeighborID, Dir);
-                }
+                GeneratedTiles[CellIndex]->Destroy();
             }
+            GeneratedTiles[CellIndex] = SpawnTileAtPosition(X, Y, Z, NewTileIndex);
         }
+        return;
     }
-}
 
-FIntPoint AWaveFunctionCollapse::FindLowestEntropyCell()
-{
-    int32 MinEntropy = INT32_MAX;
-    TArray<FIntPoint> CandidateCells;
-    
-    for (int32 X = 0; X < GridWidth; X++)
+    if (!CellInstances.IsValidIndex(CellIndex))
     {
-        for (int32 Y = 0; Y < GridHeight; Y++)
+        return;
+    }
+
+    // 实例不删除，缩放为 0 后放入空闲列表复用，避免删除导致其他实例索引变化
+    if (UStaticMesh* OldMesh = GetTileMesh(OldTileIndex))
+    {
+        UHierarchicalInstancedStaticMeshComponent** OldComponent = TileMeshComponents.Find(OldMesh);
+        if (OldComponent && IsValid(*OldComponent) && CellInstances[CellIndex] != INDEX_NONE)
         {
-            const FWFCCell& Cell = Grid[X][Y];
-            if (!Cell.bCollapsed)
-            {
-                if (Cell.Entropy < MinEntropy)
-                {
-                    MinEntropy = Cell.Entropy;
-                    CandidateCells.Empty();
-                    CandidateCells.Add(FIntPoint(X, Y));
-                }
-                else if (Cell.Entropy == MinEntropy)
-                {
-                    CandidateCells.Add(FIntPoint(X, Y));
-                }
-            }
+            (*OldComponent)->UpdateInstanceTransform(CellInstances[CellIndex], FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector), false, false);
+            FreeInstanceSlots.FindOrAdd(OldMesh).Add(CellInstances[CellIndex]);
         }
     }
-    
-    if (CandidateCells.Num() == 0)
+    CellInstances[CellIndex] = INDEX_NONE;
+
+    UStaticMesh* NewMesh = GetTileMesh(NewTileIndex);
+    if (!NewMesh)
     {
-        return FIntPoint(-1, -1);
+        return;
+    }
+
+    UHierarchicalInstancedStaticMeshComponent* MeshComponent = GetOrCreateMeshComponent(NewMesh);
+    const FTransform InstanceTransform = GetTileInstanceTransform(X, Y, Z, NewTileIndex);
+    TArray<int32>& FreeSlots = FreeInstanceSlots.FindOrAdd(NewMesh);
+    if (FreeSlots.Num() > 0)
+    {
+        CellInstances[CellIndex] = FreeSlots.Pop(EAllowShrinking::No);
+        MeshComponent->UpdateInstanceTransform(CellInstances[CellIndex], InstanceTransform, false, false);
+    }
+    else
+    {
+        CellInstances[CellIndex] = MeshComponent->AddInstance(InstanceTransform);
     }
-    
-    int32 RandomIndex = RandomStream.RandRange(0, CandidateCells.Num() - 1);
-    return CandidateCells[RandomIndex];
 }
 
-void AWaveFunctionCollapse::CollapseCell(int32 X, int32 Y)
+UStaticMesh* AWaveFunctionCollapse::GetTileMesh(int32 TileIndex) const
 {
-    FWFCCell& Cell = Grid[X][Y];
-    
-    if (Cell.PossibleTiles.Num() == 0)
+    if (!CompiledRules.IsValid() || !CompiledRules->IsValidTileIndex(TileIndex) || !TileSet.IsValidIndex(CompiledRules->SourceIndices[TileIndex]))
     {
-        UE_LOG(LogTemp, Error, TEXT("Trying to collapse cell with no possible tiles"));
-        return;
+        return nullptr;
     }
 
-    FString SelectedTile = SelectRandomTile(Cell.PossibleTiles);
-    
-    Cell.bCollapsed = true;
-    Cell.SelectedTile = SelectedTile;
-    Cell.PossibleTiles.Empty();
-    Cell.PossibleTiles.Add(SelectedTile);
-    Cell.Entropy = 1;
-    SpawnTileAtPosition(X, Y, SelectedTile);
-    
-    UE_LOG(LogTemp, Log, TEXT("Collapsed cell (%d, %d) to %s"), X, Y, *SelectedTile);
+    return TileSet[CompiledRules->SourceIndices[TileIndex]].Mesh;
 }
 
-void AWaveFunctionCollapse::PropagateConstraints(int32 X, int32 Y)
+FTransform AWaveFunctionCollapse::GetTileInstanceTransform(int32 X, int32 Y, int32 Z, int32 TileIndex) const
 {
-    TArray<FIntPoint> CellsToUpdate;
-    CellsToUpdate.Add(FIntPoint(X, Y));
-    
-    while (CellsToUpdate.Num() > 0)
+    // 变体共用源 Tile 的 Mesh，通过实例旋转/镜像呈现；Mesh 的轴心应位于格子中心
+    int32 Transform = 0;
+    if (CompiledRules.IsValid() && CompiledRules->TileTransforms.IsValidIndex(TileIndex))
     {
-        FIntPoint CurrentPos = CellsToUpdate[0];
-        CellsToUpdate.RemoveAt(0);
-        
-        TArray<FIntPoint> Neighbors = {
-            FIntPoint(CurrentPos.X, CurrentPos.Y - 1), 
-            FIntPoint(CurrentPos.X + 1, CurrentPos.Y),
-            FIntPoint(CurrentPos.X, CurrentPos.Y + 1), 
-            FIntPoint(CurrentPos.X - 1, CurrentPos.Y) 
-        };
-        
-        for (const FIntPoint& NeighborPos : Neighbors)
-        {
-            if (IsValidPosition(NeighborPos.X, NeighborPos.Y))
-            {
-                int32 OldEntropy = Grid[NeighborPos.X][NeighborPos.Y].Entropy;
-                UpdateCellPossibilities(NeighborPos.X, NeighborPos.Y);
-                if (Grid[NeighborPos.X][NeighborPos.Y].Entropy != OldEntropy)
-                {
-                    CellsToUpdate.AddUnique(NeighborPos);
-                }
-            }
-        }
+        Transform = CompiledRules->TileTransforms[TileIndex];
     }
+
+    const FRotator Rotation(0.0f, FWFCCompiledRules::GetTransformRotation(Transform) * 90.0f, 0.0f);
+    const FVector Scale(1.0f, FWFCCompiledRules::IsTransformMirrored(Transform) ? -1.0f : 1.0f, 1.0f);
+    return FTransform(Rotation, FVector(X * TileSize, Y * TileSize, Z * LayerHeight), Scale);
 }
 
-void AWaveFunctionCollapse::UpdateCellPossibilities(int32 X, int32 Y)
+// 检查所有所有规则可用
+void AWaveFunctionCollapse::ValidateTileConstraints()
 {
-    FWFCCell& Cell = Grid[X][Y];
-    
-    if (Cell.bCollapsed)
-    {
-        return;
-    }
-    
-    TArray<FString> NewPossibleTiles;
-    
-    for (const FString& TileID : Cell.PossibleTiles)
+    for (const FWFCTile& Tile : TileSet)
     {
-        bool bIsValid = true;
-        
-        TArray<FIntPoint> Neighbors = {
-            FIntPoint(X + 1 , Y     ),
-            FIntPoint(X     , Y + 1 ), 
-            FIntPoint(X - 1 , Y     ), 
-            FIntPoint(X     , Y - 1 )
+        if (Tile.TileID.IsEmpty()) continue;
+
+        TArray<TArray<FString>*> NeighborArrays = {
+            const_cast<TArray<FString>*>(&Tile.UpNeighbors),
+            const_cast<TArray<FString>*>(&Tile.RightNeighbors),
+            const_cast<TArray<FString>*>(&Tile.DownNeighbors),
+            const_cast<TArray<FString>*>(&Tile.LeftNeighbors),
+            const_cast<TArray<FString>*>(&Tile.TopNeighbors),
+            const_cast<TArray<FString>*>(&Tile.BottomNeighbors)
         };
         
-        for (int32 Dir = 0; Dir < 4; Dir++)
+        for (int32 Dir = 0; Dir < CompiledRules->NumDirections; Dir++)
         {
-            const FIntPoint& NeighborPos = Neighbors[Dir];
-            
-            if (IsValidPosition(NeighborPos.X, NeighborPos.Y))
+            for (const FString& NeighborID : *NeighborArrays[Dir])
             {
-                const FWFCCell& NeighborCell = Grid[NeighborPos.X][NeighborPos.Y];
-                
-                bool bHasValidNeighbor = false;
-                for (const FString& NeighborTileID : NeighborCell.PossibleTiles)
-                {
-                    if (IsValidNeighbor(TileID, NeighborTileID, Dir))
-                    {
-                        bHasValidNeighbor = true;
-                        break;
-                    }
-                }
-                
-                if (!bHasValidNeighbor)
+                if (!CompiledRules->TileIndexMap.Contains(NeighborID))
                 {
-                    bIsValid = false;
-                    break;
+                    UE_LOG(LogTemp, Warning, TEXT("Tile %s references non-existent neighbor %s in direction %d"), 
+                           *Tile.TileID, *NeighborID, Dir);
                 }
             }
         }
-        
-        if (bIsValid)
-        {
-            NewPossibleTiles.Add(TileID);
-        }
-    }
-    
-    Cell.PossibleTiles = NewPossibleTiles;
-    Cell.Entropy = Cell.PossibleTiles.Num();
-}
-
-bool AWaveFunctionCollapse::IsValidNeighbor(const FString& TileID, const FString& NeighborID, int32 Direction)
-{
-    if (!TileMap.Contains(TileID))
-    {
-        return false;
-    }
-    
-    const FWFCTile& Tile = TileMap[TileID];
-    
-    switch (Direction)
-    {
-        case 0: // 上
-            return Tile.UpNeighbors.Contains(NeighborID);
-        case 1: // 右
-            return Tile.RightNeighbors.Contains(NeighborID);
-        case 2: // 下
-            return Tile.DownNeighbors.Contains(NeighborID);
-        case 3: // 左
-            return Tile.LeftNeighbors.Contains(NeighborID);
-        default:
-            return false;
     }
 }
 
-void AWaveFunctionCollapse::SpawnTileAtPosition(int32 X, int32 Y, const FString& TileID)
+AWFCTileActor* AWaveFunctionCollapse::SpawnTileAtPosition(int32 X, int32 Y, int32 Z, int32 TileIndex)
 {
-    if (!TileMap.Contains(TileID))
+    if (!CompiledRules->IsValidTileIndex(TileIndex))
     {
-        UE_LOG(LogTemp, Warning, TEXT("Tile ID %s not found in TileMap"), *TileID);
-        return;
+        UE_LOG(LogTemp, Warning, TEXT("Tile index %d not found in compiled rules"), TileIndex);
+        return nullptr;
     }
     
-    const FWFCTile& Tile = TileMap[TileID];
+    const FString& TileID = CompiledRules->TileIDs[TileIndex];
     
     if (TileActorClass)
     {
    
-        FVector Position = GetActorLocation() + FVector(X * TileSize, Y * TileSize, 0.0f);
-        FRotator Rotation = GetActorRotation();
+        FVector Position = GetActorLocation() + FVector(X * TileSize, Y * TileSize, Z * LayerHeight);
+        const FTransform VariantTransform = GetTileInstanceTransform(X, Y, Z, TileIndex);
+        FRotator Rotation = GetActorRotation() + VariantTransform.Rotator();
         // 生成Tile Actor
 
         FActorSpawnParameters SpawnParams;
@@ -568,72 +1162,110 @@ void AWaveFunctionCollapse::SpawnTileAtPosition(int32 X, int32 Y, const FString&
         if (TileActor)
         {
             // 设置网格和ID
-            TileActor->SetTileMesh(Tile.Mesh);
+            TileActor->SetTileMesh(GetTileMesh(TileIndex));
             TileActor->SetTileID(TileID);
+            TileActor->SetActorScale3D(VariantTransform.GetScale3D());
             
-            // 保存引用以便后续清理
-            GeneratedTiles.Add(TileActor);
-            
-            UE_LOG(LogTemp, Log, TEXT("Spawned tile %s at position (%d, %d)"), *TileID, X, Y);
+            UE_LOG(LogTemp, Verbose, TEXT("Spawned tile %s at position (%d, %d, %d)"), *TileID, X, Y, Z);
         }
         else
         {
             UE_LOG(LogTemp, Error, TEXT("Failed to spawn tile actor for %s"), *TileID);
         }
+
+        return TileActor;
     }
     else
     {
         UE_LOG(LogTemp, Warning, TEXT("TileActorClass not set"));
     }
+
+    return nullptr;
 }
 
-void AWaveFunctionCollapse::ClearGeneratedMeshes()
+void AWaveFunctionCollapse::CommitInstancedMeshes()
 {
-    for (AWFCTileActor* TileActor : GeneratedTiles)
+    // 先按 Mesh 收集变换，每个组件只调用一次 AddInstances
+    TMap<UStaticMesh*, TArray<FTransform>> InstancesByMesh;
+    TMap<UStaticMesh*, TArray<int32>> CellsByMesh;
+    for (int32 X = 0; X < GridWidth; X++)
     {
-        if (TileActor && IsValid(TileActor))
+        for (int32 Y = 0; Y < GridHeight; Y++)
         {
-            TileActor->Destroy();
+            for (int32 Z = 0; Z < GridDepth; Z++)
+            {
+                const int32 TileIndex = SolvedTiles[GetCellIndex(X, Y, Z)];
+                if (UStaticMesh* Mesh = GetTileMesh(TileIndex))
+                {
+                    InstancesByMesh.FindOrAdd(Mesh).Add(GetTileInstanceTransform(X, Y, Z, TileIndex));
+                    CellsByMesh.FindOrAdd(Mesh).Add(GetCellIndex(X, Y, Z));
+                }
+            }
         }
     }
-    GeneratedTiles.Empty();
-}
 
-bool AWaveFunctionCollapse::IsValidPosition(int32 X, int32 Y) const
-{
-    return X >= 0 && X < GridWidth && Y >= 0 && Y < GridHeight;
+    // 记录每个格子的实例索引，局部重解时只更新变化的实例
+    CellInstances.Init(INDEX_NONE, GetNumCells());
+    for (TPair<UStaticMesh*, TArray<FTransform>>& Pair : InstancesByMesh)
+    {
+        if (UHierarchicalInstancedStaticMeshComponent* MeshComponent = GetOrCreateMeshComponent(Pair.Key))
+        {
+            const TArray<int32> InstanceIndices = MeshComponent->AddInstances(Pair.Value, true);
+            const TArray<int32>& Cells = CellsByMesh[Pair.Key];
+            for (int32 Index = 0; Index < InstanceIndices.Num(); Index++)
+            {
+                CellInstances[Cells[Index]] = InstanceIndices[Index];
+            }
+        }
+    }
+
+    UE_LOG(LogTemp, Verbose, TEXT("Committed %d cells as %d instanced meshes"), SolvedTiles.Num(), InstancesByMesh.Num());
 }
 
-FString AWaveFunctionCollapse::SelectRandomTile(const TArray<FString>& PossibleTiles)
+UHierarchicalInstancedStaticMeshComponent* AWaveFunctionCollapse::GetOrCreateMeshComponent(UStaticMesh* Mesh)
 {
-    if (PossibleTiles.Num() == 0)
+    if (UHierarchicalInstancedStaticMeshComponent** Existing = TileMeshComponents.Find(Mesh))
     {
-        return "";
+        if (IsValid(*Existing))
+        {
+            return *Existing;
+        }
     }
-    
-    float TotalWeight = 0.0f;
-    for (const FString& TileID : PossibleTiles)
+
+    UHierarchicalInstancedStaticMeshComponent* MeshComponent = NewObject<UHierarchicalInstancedStaticMeshComponent>(this);
+    MeshComponent->SetStaticMesh(Mesh);
+    MeshComponent->SetupAttachment(RootComponent);
+    MeshComponent->RegisterComponent();
+    AddInstanceComponent(MeshComponent);
+
+    TileMeshComponents.Add(Mesh, MeshComponent);
+    return MeshComponent;
+}
+
+void AWaveFunctionCollapse::ClearGeneratedMeshes()
+{
+    // 组件保留，下次生成直接复用
+    for (TPair<UStaticMesh*, UHierarchicalInstancedStaticMeshComponent*>& Pair : TileMeshComponents)
     {
-        if (TileMap.Contains(TileID))
+        if (IsValid(Pair.Value))
         {
-            TotalWeight += TileMap[TileID].Weight;
+            Pair.Value->ClearInstances();
         }
     }
+    CellInstances.Empty();
+    FreeInstanceSlots.Empty();
 
-    float RandomValue = RandomStream.FRandRange(0.0f, TotalWeight);
-    float CurrentWeight = 0.0f;
-    
-    for (const FString& TileID : PossibleTiles)
+    for (AWFCTileActor* TileActor : GeneratedTiles)
     {
-        if (TileMap.Contains(TileID))
+        if (TileActor && IsValid(TileActor))
         {
-            CurrentWeight += TileMap[TileID].Weight;
-            if (RandomValue <= CurrentWeight)
-            {
-                return TileID;
-            }
+            TileActor->Destroy();
         }
     }
+    GeneratedTiles.Empty();
+}
 
-    return PossibleTiles[0];
-}
\ No newline at end of file
+bool AWaveFunctionCollapse::IsValidPosition(int32 X, int32 Y, int32 Z) const
+{
+    return X >= 0 && X < GridWidth && Y >= 0 && Y < GridHeight && Z >= 0 && Z < GridDepth;
+}
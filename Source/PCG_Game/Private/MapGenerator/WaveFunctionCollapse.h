@@ -2,10 +2,36 @@
 
 #include "CoreMinimal.h"
 #include "WFCTileActor.h"
+#include "WFCCompiledRules.h"
+#include "WFCSolver.h"
+#include "WFCSavedMap.h"
+#include "Misc/SecureHash.h"
 #include "GameFramework/Actor.h"
 #include "Components/StaticMeshComponent.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
 #include "WaveFunctionCollapse.generated.h"
 
+// 编译时按对称类自动展开旋转/镜像变体，邻居规则随之变换
+// 变换为先沿 X 轴镜像（Y 取反）再绕 Z 轴旋转，手写邻居列表描述的是未变换的 Tile
+UENUM(BlueprintType)
+enum class EWFCTileSymmetry : uint8
+{
+    // 不展开，邻居规则按手写使用
+    None        UMETA(DisplayName = "None"),
+    // 旋转与镜像均不变，1 个变体
+    X           UMETA(DisplayName = "X"),
+    // 关于 X 轴对称（T 的竖笔沿 X 轴），4 个变体
+    T           UMETA(DisplayName = "T"),
+    // 180° 旋转与两轴镜像不变（直线），2 个变体
+    I           UMETA(DisplayName = "I"),
+    // 关于对角线 X = Y 对称（连接 +X 与 +Y 的拐角），4 个变体
+    L           UMETA(DisplayName = "L"),
+    // 180° 旋转与两条对角线镜像不变，2 个变体
+    Backslash   UMETA(DisplayName = "\\"),
+    // 无对称，8 个变体
+    F           UMETA(DisplayName = "F"),
+};
+
 USTRUCT(BlueprintType)
 struct FWFCTile
 {
@@ -28,10 +54,21 @@ struct FWFCTile
 
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
     TArray<FString> LeftNeighbors;
+
+    // 仅 GridDepth > 1 时使用：+Z / -Z 方向
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    TArray<FString> TopNeighbors;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    TArray<FString> BottomNeighbors;
     
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
     float Weight = 1.0f;
 
+    // 变体 ID 为 TileID#k（k > 0），邻居列表中可直接引用；渲染时使用同一 Mesh 加实例旋转/镜像
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    EWFCTileSymmetry Symmetry = EWFCTileSymmetry::None;
+
     FWFCTile()
     {
         Mesh = nullptr;
@@ -40,39 +77,48 @@ struct FWFCTile
     }
 };
 
-USTRUCT()
-struct FWFCCell
+// 全局数量约束，作用于该 TileID 的所有旋转/镜像变体
+USTRUCT(BlueprintType)
+struct FWFCTileCountLimit
 {
     GENERATED_BODY()
 
-    TArray<FString> PossibleTiles;
-    bool bCollapsed = false;
-    FString SelectedTile = "";
-    
-    int32 Entropy = 0;
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    FString TileID;
 
-    FWFCCell()
-    {
-        bCollapsed = false;
-        SelectedTile = "";
-        Entropy = 0;
-    }
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, meta = (ClampMin = "0"))
+    int32 MinCount = 0;
+
+    // 小于 0 表示不限
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    int32 MaxCount = -1;
 };
 
-USTRUCT()
-struct FWFCSnapshot
+// 预设格子：求解前把格子限制为 AllowedTileIDs 中的 Tile（含其变体），只有一个时即为固定 Tile
+USTRUCT(BlueprintType)
+struct FWFCCellAnchor
 {
     GENERATED_BODY()
 
-    TArray<TArray<FWFCCell>> GridState;
-    FIntPoint LastCollapsedCell;
-    
-    FWFCSnapshot()
-    {
-        LastCollapsedCell = FIntPoint(-1, -1);
-    }
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    FIntVector Cell = FIntVector::ZeroValue;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    TArray<FString> AllowedTileIDs;
+};
+
+UENUM(BlueprintType)
+enum class EWFCOutputMode : uint8
+{
+    // 每个格子生成一个 AWFCTileActor
+    Actors              UMETA(DisplayName = "Actors"),
+    // 按 Mesh 分组，每种 Mesh 一个 HISM 组件，求解后一次性批量添加实例
+    InstancedMeshes     UMETA(DisplayName = "Instanced Meshes"),
 };
 
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnWFCGenerationProgress, float, Progress);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnWFCGenerationCompleted, bool, bSuccess);
+
 UCLASS()
 class PCG_GAME_API AWaveFunctionCollapse : public AActor
 {
@@ -83,18 +129,34 @@ public:
 
 protected:
     virtual void BeginPlay() override;
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+public:
+    virtual void Tick(float DeltaTime) override;
+
+protected:
     
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings")
     int32 GridWidth = 10;
 
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings")
     int32 GridHeight = 10;
+
+    // 大于 1 时为多层体素网格，启用 Top/Bottom 邻接规则，建议搭配 InstancedMeshes 输出
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings", meta = (ClampMin = "1"))
+    int32 GridDepth = 1;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings", meta = (EditCondition = "GridDepth > 1"))
+    float LayerHeight = 100.0f;
     
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings")
     float TileSize = 100.0f;
     
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings")
     TArray<FWFCTile> TileSet;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings")
+    bool bGenerateOnBeginPlay = true;
     
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings")
     int32 RandomSeed = 5201314;
@@ -103,11 +165,18 @@ protected:
     int32 MaxIterations = 1000;
 
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings")
+    EWFCOutputMode OutputMode = EWFCOutputMode::Actors;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings", meta = (EditCondition = "OutputMode == EWFCOutputMode::Actors"))
     TSubclassOf<AWFCTileActor> TileActorClass;
     
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings")
     bool bEnableBacktracking = true;
 
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings")
+    EWFCBacktrackMode BacktrackMode = EWFCBacktrackMode::Snapshot;
+
+    // Snapshot 模式下为保存的快照数，Trail 模式下为可撤销的决策深度
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings")
     int32 MaxBacktrackSteps = 10;
 
@@ -115,19 +184,99 @@ protected:
     int32 MaxRetries = 3;
 
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings")
-    bool bAllowFallbackTiles = true;
+    EWFCPropagatorMode PropagatorMode = EWFCPropagatorMode::Rescan;
+
+    // 全局约束在求解过程中增量检查，违反时触发回溯；局部重解（ResolveRegion）时不生效
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Global Constraints")
+    TArray<FWFCTileCountLimit> TileCountLimits;
+
+    // 非空时所有塌陷为这些 Tile 的格子必须构成一个连通区域
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Global Constraints")
+    TArray<FString> WalkableTileIDs;
+
+    // 入口、边界墙等预设格子，每次尝试初始化后一次性剔除并批量传播，再开始塌陷
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Anchors")
+    TArray<FWFCCellAnchor> CellAnchors;
+
+    // 分帧求解：每帧最多推进 MaxCollapsesPerTick 次塌陷或 TickBudgetMicroseconds 微秒，0 表示不限
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Time Slicing")
+    bool bTimeSliced = false;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Time Slicing", meta = (EditCondition = "bTimeSliced", ClampMin = "0"))
+    int32 MaxCollapsesPerTick = 64;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Time Slicing", meta = (EditCondition = "bTimeSliced", ClampMin = "0", Units = "Microseconds"))
+    float TickBudgetMicroseconds = 2000.0f;
 
+    // 在后台任务中求解，游戏线程只负责最终的生成；开启时忽略 bTimeSliced
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Async")
+    bool bSolveAsync = false;
+
+    // 后台同时求解 SpeculativeSolveCount 个派生种子，第一个成功的结果胜出
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Async", meta = (EditCondition = "bSolveAsync"))
+    bool bSpeculativeSolve = false;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Async", meta = (EditCondition = "bSolveAsync && bSpeculativeSolve", ClampMin = "1"))
+    int32 SpeculativeSolveCount = 4;
+
+    // 编译结果按 TileSet 内容哈希缓存到 Saved/WFCCache，内容未变时直接加载，跳过编译
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Cache")
+    bool bUseRuleCache = true;
+
+    // Saved/WFCCache 中最多保留的规则文件数，超出时删除最久未使用的；为 0 时只缓存在内存中
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Cache", meta = (EditCondition = "bUseRuleCache", ClampMin = "0"))
+    int32 MaxCachedRuleFiles = 32;
+
+    // 成功求解的地图按 (规则哈希, RandomSeed, 尺寸, 求解设置) 缓存在内存 LRU 与 Saved/WFCMaps 中，再次生成时直接加载
+    // 每次随机种子的项目几乎不会命中，默认关闭
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Cache")
+    bool bUseMapCache = false;
+
+    // Saved/WFCMaps 中最多保留的地图文件数，超出时删除最久未使用的；为 0 时只缓存在内存中
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "WFC Settings|Cache", meta = (EditCondition = "bUseMapCache", ClampMin = "0"))
+    int32 MaxCachedMapFiles = 64;
+
+    // 最近一次成功求解实际使用的种子，设为 RandomSeed 即可复现同一张地图
+    UPROPERTY(VisibleInstanceOnly, BlueprintReadOnly, Category = "WFC")
+    int32 LastSolvedSeed = 0;
+
+public:
+    UPROPERTY(BlueprintAssignable, Category = "WFC")
+    FOnWFCGenerationProgress OnGenerationProgress;
+
+    UPROPERTY(BlueprintAssignable, Category = "WFC")
+    FOnWFCGenerationCompleted OnGenerationCompleted;
+
+
+protected:
+    // 编译后的规则只读共享给求解器，重新编译时整体替换
+    TSharedPtr<FWFCCompiledRules> CompiledRules;
+
+    // 最近一次编译所用 TileSet 的内容哈希
+    FSHAHash RulesHash;
 
 private:
-    TArray<TArray<FWFCCell>> Grid;
 
-    TMap<FString, FWFCTile> TileMap;
+    // 本次求解完成后写入地图缓存所用的键，未启用缓存时为空
+    FString PendingMapKey;
 
+    // 求解状态机，同步、分帧与后台求解共用同一套步进逻辑，保证同一 RandomSeed 结果一致
+    TSharedPtr<FWFCSolver> ActiveSolver;
+    TSharedPtr<FWFCSpeculativeSolve> ActiveAsyncSolve;
+
+    // 最近一次成功求解的 Tile 索引，按 (X * GridHeight + Y) * GridDepth + Z 展平
+    TArray<int32> SolvedTiles;
+
+    // Actors 模式下按格子索引保存，未生成的格子为空
     TArray<AWFCTileActor*> GeneratedTiles;
 
-    FRandomStream RandomStream;
-    TArray<FWFCSnapshot> Snapshots;
-    int32 CurrentRetry = 0;
+    // InstancedMeshes 模式下每种 Mesh 对应的 HISM 组件，重新生成时复用
+    UPROPERTY(Transient)
+    TMap<UStaticMesh*, UHierarchicalInstancedStaticMeshComponent*> TileMeshComponents;
+
+    // 每个格子在其 Mesh 组件中的实例索引，以及局部重解后空出的实例
+    TArray<int32> CellInstances;
+    TMap<UStaticMesh*, TArray<int32>> FreeInstanceSlots;
 
 public:
     UFUNCTION(BlueprintCallable, Category = "WFC")
@@ -139,29 +288,89 @@ public:
     UFUNCTION(BlueprintCallable, Category = "WFC")
     void SetSeed(int32 NewSeed);
 
+    // 返回已塌陷格子的 TileID，未塌陷或越界时返回空串
+    UFUNCTION(BlueprintCallable, Category = "WFC")
+    FString GetTileIDAt(int32 X, int32 Y, int32 Z = 0) const;
+
+    UFUNCTION(BlueprintCallable, Category = "WFC")
+    void CancelGeneration();
+
+    UFUNCTION(BlueprintPure, Category = "WFC")
+    bool IsGenerating() const { return ActiveSolver.IsValid() || ActiveAsyncSolve.IsValid(); }
+
+    UFUNCTION(BlueprintPure, Category = "WFC")
+    float GetGenerationProgress() const;
+
+    UFUNCTION(BlueprintPure, Category = "WFC")
+    int32 GetLastSolvedSeed() const { return LastSolvedSeed; }
+
+    // 预设格子只影响之后的 GenerateGrid / ResolveRegion，同一格子再次设置时覆盖
+    UFUNCTION(BlueprintCallable, Category = "WFC|Anchors")
+    void SetCellTile(int32 X, int32 Y, int32 Z, const FString& TileID);
+
+    UFUNCTION(BlueprintCallable, Category = "WFC|Anchors")
+    void SetCellAllowedTiles(int32 X, int32 Y, int32 Z, const TArray<FString>& TileIDs);
+
+    UFUNCTION(BlueprintCallable, Category = "WFC|Anchors")
+    void ClearCellConstraints();
+
+    // 保存最近一次成功生成的地图，可用 LoadMapFromFile 直接还原而无需求解
+    UFUNCTION(BlueprintCallable, Category = "WFC")
+    bool SaveMapToFile(const FString& FilePath) const;
+
+    // 规则哈希必须与当前 TileSet 一致；成功时网格尺寸改为存档中的尺寸
+    UFUNCTION(BlueprintCallable, Category = "WFC")
+    bool LoadMapFromFile(const FString& FilePath);
+
+    // 以区域外的格子为固定边界，只重新求解矩形区域并替换发生变化的格子
+    UFUNCTION(BlueprintCallable, Category = "WFC")
+    bool ResolveRegion(int32 RegionX, int32 RegionY, int32 RegionWidth, int32 RegionHeight, int32 Seed);
+
+protected:
+    // 生成 CompiledRules，子类可从其他来源（如样例图）构建规则
+    virtual void CompileTileSet();
+    FWFCSolverSettings MakeSolverSettings() const;
+
+    // TileID 对应的全部编译后 Tile（含变体），找不到时返回 false
+    bool GetTilesForID(const FString& TileID, TBitArray<>& OutTiles) const;
+
+    // 将 CellAnchors 解析为编译后 Tile 的位集，跳过越界或没有有效 Tile 的预设
+    void GetCellAnchorConstraints(TArray<TPair<FIntVector, TBitArray<>>>& OutConstraints) const;
+    virtual UStaticMesh* GetTileMesh(int32 TileIndex) const;
+    FTransform GetTileInstanceTransform(int32 X, int32 Y, int32 Z, int32 TileIndex) const;
+
+    // 只包含影响编译结果的字段，Mesh 不参与
+    FSHAHash ComputeTileSetHash(int32 NumDirections) const;
+
+    // 已塌陷格子的 Tile 索引，未塌陷或越界时返回 INDEX_NONE
+    int32 GetTileIndexAt(int32 X, int32 Y, int32 Z = 0) const;
+
 private:
-    void InitializeGrid();
     bool SolveWFC();
-    bool SolveWFCWithBacktracking();
+    void LaunchAsyncSolve();
+    void FinishSolve(const TSharedPtr<FWFCSolver>& Solver);
+    void CommitSolvedGrid();
+    void CommitInstancedMeshes();
+    UHierarchicalInstancedStaticMeshComponent* GetOrCreateMeshComponent(UStaticMesh* Mesh);
     
-    FIntPoint FindLowestEntropyCell();
-    void CollapseCell(int32 X, int32 Y);
-    void PropagateConstraints(int32 X, int32 Y);
-    void UpdateCellPossibilities(int32 X, int32 Y);
-    bool IsValidNeighbor(const FString& TileID, const FString& NeighborID, int32 Direction);
-    void SpawnTileAtPosition(int32 X, int32 Y, const FString& TileID);
+    AWFCTileActor* SpawnTileAtPosition(int32 X, int32 Y, int32 Z, int32 TileIndex);
+    void UpdateCellOutput(int32 X, int32 Y, int32 Z, int32 OldTileIndex, int32 NewTileIndex);
+
     void ClearGeneratedMeshes();
     
-    bool IsValidPosition(int32 X, int32 Y) const;
-    FString SelectRandomTile(const TArray<FString>& PossibleTiles);
-    
-    void SaveSnapshot(const FIntPoint& LastCollapsedCell);
-    bool RestoreSnapshot();
-    void ClearSnapshots();
-    
-    bool HasContradiction() const;
-    void HandleContradiction();
-    FString GetFallbackTile(int32 X, int32 Y);
+    bool IsValidPosition(int32 X, int32 Y, int32 Z = 0) const;
+    int32 GetCellIndex(int32 X, int32 Y, int32 Z = 0) const { return (X * GridHeight + Y) * GridDepth + Z; }
+    int32 GetNumCells() const { return GridWidth * GridHeight * GridDepth; }
     void ValidateTileConstraints();
+
+    bool LoadCachedRules(const FSHAHash& Hash);
+    void SaveCachedRules(const FSHAHash& Hash) const;
+    static FString GetRuleCachePath(const FSHAHash& Hash);
+
+    FString GetMapCacheKey() const;
+    bool TryLoadCachedMap(const FString& MapKey);
+    void CacheSolvedMap(const FString& MapKey);
+    bool ApplySavedMap(const FWFCSavedMap& Map);
+    static FString GetMapCachePath(const FString& MapKey);
     
 };
\ No newline at end of file